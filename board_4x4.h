@@ -0,0 +1,204 @@
+// The 4x4 board shared by dump.cc, filter.cc and tablebase.cc: O in the low 16
+// bits and X in the high 16 bits of a uint32, the ternary index of a board and
+// the 32 symmetries. The tablebase stores canonical positions, so all three
+// programs must agree on the transform numbering defined here.
+#ifndef BOARD_4X4_H
+#define BOARD_4X4_H
+
+#include <cstdint>
+#include <utility>
+
+typedef uint32_t board;
+
+constexpr int32_t _3pow16 = 43046721;
+constexpr int32_t win_line_count = 10;
+constexpr board win_line[win_line_count] = {
+	0b1000100010001000,
+	0b0100010001000100,
+	0b0010001000100010,
+	0b0001000100010001,
+	0b1111000000000000,
+	0b0000111100000000,
+	0b0000000011110000,
+	0b0000000000001111,
+	0b1000010000100001,
+	0b0001001001001000
+};
+
+constexpr bool is_ordered( board b ) {
+	bool v = false;
+	for( int c = 0; c < 2; ++c ) {
+		#pragma unroll
+		for( int i = 0; i < win_line_count; ++i )
+			v |= ( ( b & win_line[i] ) == win_line[i] );
+		if( v )
+			return true;
+		b >>= 16;
+	}
+	return false;
+}
+
+constexpr bool is_full( board b ) {
+	return __builtin_popcount( b ) == 16;
+}
+
+constexpr bool is_done( board b ) {
+	for( int i = 0; i < win_line_count; ++i ) {
+		if( ( b & win_line[i] ) and ( ( b >> 16 ) & win_line[i] ) )
+			continue;
+		return false;
+	}
+	return true;
+}
+
+// Ternary index <-> board conversion is done eight trits (one byte of each half)
+// at a time: trits_of_byte maps the set bits of a byte to their ternary value and
+// half_of_trits maps eight trits back to an O byte and an X byte.
+struct ternary_table {
+	int32_t pow3[17];
+	int32_t trits_of_byte[256];
+	uint16_t half_of_trits[6561];
+	constexpr ternary_table() : pow3(), trits_of_byte(), half_of_trits() {
+		pow3[0] = 1;
+		for( int i = 1; i <= 16; ++i )
+			pow3[i] = 3*pow3[i-1];
+		for( int x = 0; x < 256; ++x )
+			for( int i = 0; i < 8; ++i )
+				if( ( x >> i ) & 1 )
+					trits_of_byte[x] += pow3[i];
+		for( int t = 0; t < 6561; ++t ) {
+			int index = t;
+			for( int i = 0; i < 8; ++i ) {
+				int digit = index % 3;
+				index /= 3;
+				half_of_trits[t] |= ( ( digit & 1 ) << i ) | ( ( digit >> 1 ) << ( i+8 ) );
+			}
+		}
+	}
+};
+
+constexpr ternary_table ternary;
+
+constexpr board index_to_board( int32_t index ) {
+	board lo = ternary.half_of_trits[index % 6561];
+	board hi = ternary.half_of_trits[index / 6561];
+	return ( lo & 0xff ) | ( ( hi & 0xff ) << 8 ) | ( ( lo >> 8 ) << 16 ) | ( ( hi >> 8 ) << 24 );
+}
+
+constexpr int32_t board_to_index( board b ) {
+	int32_t lo = ternary.trits_of_byte[b & 0xff] + 2*ternary.trits_of_byte[( b >> 16 ) & 0xff];
+	int32_t hi = ternary.trits_of_byte[( b >> 8 ) & 0xff] + 2*ternary.trits_of_byte[b >> 24];
+	return lo + 6561*hi;
+}
+
+constexpr board toggle( board b ) {
+	return ( b << 16 ) | ( b >> 16 );
+}
+
+constexpr board mirror( board b ) {
+	board s = b & 0b10001000100010001000100010001000;
+	board t = b & 0b01000100010001000100010001000100;
+	board u = b & 0b00100010001000100010001000100010;
+	board v = b & 0b00010001000100010001000100010001;
+	return (s >> 3) | (t >> 1) | (u << 1) | (v << 3);
+}
+
+constexpr board rotate( board b ) {
+	return 
+	 (( b & 0b10000000000000001000000000000000 ) >> 3  )
+	|(( b & 0b01000000000000000100000000000000 ) >> 6  )
+	|(( b & 0b00100000000000000010000000000000 ) >> 9  )
+	|(( b & 0b00010000000000000001000000000000 ) >> 12 )
+	|(( b & 0b00001000000000000000100000000000 ) << 2  )
+	|(( b & 0b00000100000000000000010000000000 ) >> 1  )
+	|(( b & 0b00000010000000000000001000000000 ) >> 4  )
+	|(( b & 0b00000001000000000000000100000000 ) >> 7  )
+	|(( b & 0b00000000100000000000000010000000 ) << 7  )
+	|(( b & 0b00000000010000000000000001000000 ) << 4  )
+	|(( b & 0b00000000001000000000000000100000 ) << 1  )
+	|(( b & 0b00000000000100000000000000010000 ) >> 2  )
+	|(( b & 0b00000000000010000000000000001000 ) << 12 )
+	|(( b & 0b00000000000001000000000000000100 ) << 9  )
+	|(( b & 0b00000000000000100000000000000010 ) << 6  )
+	|(( b & 0b00000000000000010000000000000001 ) << 3  );
+}
+
+constexpr board invert( board b ) {
+	return 
+	 (( b & 0b10100000101000001010000010100000 ) >> 5  )
+	|(( b & 0b01010000010100000101000001010000 ) >> 3  )
+	|(( b & 0b00001010000010100000101000001010 ) << 3  )
+	|(( b & 0b00000101000001010000010100000101 ) << 5  );
+}
+
+// The 16 cell permutations of the symmetry group (those visited by canonical_slow
+// in filter.cc) are mirror^s, invert^t and rotate^v applied in that order;
+// transform k = 8*s+4*t+v. Each is tabulated per byte of a 16 bit half so that a
+// half is permuted with two lookups. The colour toggle commutes with all of them
+// and is handled by swapping the halves.
+struct symmetry_table {
+	uint16_t lo[16][256];
+	uint16_t hi[16][256];
+	constexpr symmetry_table() : lo(), hi() {
+		for( int k = 0; k < 16; ++k ) {
+			for( int i = 0; i < 16; ++i ) {
+				board b = board( 1 ) << i;
+				if( k & 8 )
+					b = mirror( b );
+				if( k & 4 )
+					b = invert( b );
+				for( int v = 0; v < ( k & 3 ); ++v )
+					b = rotate( b );
+				for( int x = 0; x < 256; ++x ) {
+					if( i < 8 and ( x >> i ) & 1 )
+						lo[k][x] |= b;
+					if( i >= 8 and ( x >> ( i-8 ) ) & 1 )
+						hi[k][x] |= b;
+				}
+			}
+		}
+	}
+};
+
+constexpr symmetry_table symmetry;
+
+constexpr board permute_half( int k, board h ) {
+	return symmetry.lo[k][h & 0xff] | symmetry.hi[k][h >> 8];
+}
+
+// Transform t applies cell permutation t>>1 and toggles the colours if t&1.
+constexpr board apply_symmetry( board b, int t ) {
+	board o = permute_half( t >> 1, b & 0xffff );
+	board x = permute_half( t >> 1, b >> 16 );
+	return ( t & 1 ) ? ( ( o << 16 ) | x ) : ( ( x << 16 ) | o );
+}
+
+// Returns the smallest image of b under the 32 symmetries together with the
+// transform that produces it.
+constexpr std::pair<board,int> canonical_transform( board b ) {
+	board c = b;
+	int ct = 0;
+	board o = b & 0xffff;
+	board x = b >> 16;
+	for( int k = 0; k < 16; ++k ) {
+		board po = permute_half( k, o );
+		board px = permute_half( k, x );
+		board d = ( px << 16 ) | po;
+		board e = ( po << 16 ) | px;
+		if( d < c ) {
+			c = d;
+			ct = 2*k;
+		}
+		if( e < c ) {
+			c = e;
+			ct = 2*k+1;
+		}
+	}
+	return { c, ct };
+}
+
+constexpr board canonical( board b ) {
+	return canonical_transform( b ).first;
+}
+
+#endif
@@ -1,17 +1,16 @@
 from sklearn import tree
 import graphviz
-import json
+import numpy
 
 print "Reading data..."
-ovc = None
-with open("order.json") as f:
-	ovc = json.load( f )
+data = numpy.load( "order_data.npy", mmap_mode='r' )
+target = numpy.load( "order_target.npy", mmap_mode='r' )
 
 print "Fitting data..."
 dt = tree.DecisionTreeClassifier()
-dt = dt.fit( ovc['data'], ovc['target'] )
+dt = dt.fit( data, target )
 
-print "Score:", dt.score( ovc['data'], ovc['target'] )
+print "Score:", dt.score( data, target )
 
 print "Exporting..."
 tree.export_graphviz( dt, out_file="tree.dot" ) 
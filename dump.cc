@@ -1,6 +1,12 @@
 #include <iostream>
 #include <bitset>
 #include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "perf_counters.h"
+#include "board_4x4.h"
 
 #define popcount __builtin_popcount
 
@@ -12,73 +18,14 @@
 
 #define CAN_PASS 1
 
-typedef uint32_t board;
-
-constexpr int32_t _3pow16 = 43046721;
 constexpr int32_t total_bytes = (_3pow16+7)/8;
-constexpr int32_t win_line_count = 10;
-
-constexpr board win_line[win_line_count] = {
-	0b1000100010001000,
-	0b0100010001000100,
-	0b0010001000100010,
-	0b0001000100010001,
-	0b1111000000000000,
-	0b0000111100000000,
-	0b0000000011110000,
-	0b0000000000001111,
-	0b1000010000100001,
-	0b0001001001001000
-};
-
-constexpr bool is_ordered( board b ) {
-	bool v = false;
-	for( int c = 0; c < 2; ++c ) {
-		#pragma unroll
-		for( int i = 0; i < win_line_count; ++i )
-			v |= ( ( b & win_line[i] ) == win_line[i] );
-		if( v )
-			return true;
-		b >>= 16;
-	}
-	return false;
-}
-
-constexpr bool is_full( board b ) {
-	return popcount( b ) == 16;
-}
 
 constexpr bool is_sane( board b ) {
 	return ( b & ( b >> 16 ) ) == 0;
 }
 
-constexpr board index_to_board( int32_t index ) {
-	board r = 0;
-	int digit = 0;
-	for( int i = 0; i < 16; ++i ) {
-		digit = index % 3;
-		index /= 3;
-		r |= ( digit & 1 ) << i;
-		r |= ( digit >> 1 ) << (i+16);
-	}
-	return r;
-}
-
-constexpr int32_t board_to_index( board b ) {
-	int32_t index = 0;
-	int digit = 0;
-	for( int i = 15; i >= 0; --i ) {
-		digit = ( (b>>i) & 1 ) + 2*( (b>>(i+16)) & 1 );
-		index = 3*index+digit;
-	}
-	return index;
-}
-
 constexpr int32_t move_on_index( int32_t index, int i, bool s ) {
-	int digit = (!!s)+1;
-	for( int j = 0; j < i; ++j )
-		digit *= 3;
-	return index + digit;
+	return index + ( (!!s)+1 ) * ternary.pow3[i];
 }
 
 constexpr bool can_move_on_board( board b, int i ) {
@@ -100,29 +47,84 @@ bool conversion_correct() {
 	return 1;
 }
 
-std::bitset<_3pow16> memo[2];
+// Memory layout of the solver table, selected at compile time:
+// 0: one bitset per player
+// 1: the ORDER and CHAOS bits of an index next to each other
+// 2: blocks of the 81 indices that share all but the lowest four trits, padded to
+//    128 bits per player, with both players of a block in one 32 byte unit; this
+//    layout is solved a block at a time by fill_all_memo_wide
+#ifndef MEMO_LAYOUT
+#define MEMO_LAYOUT 2
+#endif
+
+class memo_table {
+	std::vector<uint64_t> words;
+public:
+	static constexpr int64_t bit_count = MEMO_LAYOUT == 2 ? int64_t( _3pow16/81 ) * 256 : 2 * int64_t( ( _3pow16+63 ) & ~63 );
+	static constexpr int64_t bit( bool p, int32_t index ) {
+		if( MEMO_LAYOUT == 1 )
+			return 2*int64_t( index ) + p;
+		if( MEMO_LAYOUT == 2 )
+			return int64_t( index / 81 ) * 256 + p * 128 + index % 81;
+		return p * int64_t( ( _3pow16+63 ) & ~63 ) + index;
+	}
+	bool get( bool p, int32_t index ) const {
+		int64_t k = bit( p, index );
+		return ( words[k >> 6] >> ( k & 63 ) ) & 1;
+	}
+	bool set( bool p, int32_t index, bool v ) {
+		int64_t k = bit( p, index );
+		words[k >> 6] = ( words[k >> 6] & ~( uint64_t( 1 ) << ( k & 63 ) ) ) | ( uint64_t( v ) << ( k & 63 ) );
+		return v;
+	}
+	// same text format as std::bitset, highest index first
+	void write( std::ostream& os, bool p ) const {
+		std::string s( _3pow16, '0' );
+		for( int32_t index = 0; index < _3pow16; ++index )
+			if( get( p, index ) )
+				s[_3pow16-1-index] = '1';
+		os << s;
+	}
+#if MEMO_LAYOUT == 2
+	typedef unsigned __int128 block_bits;
+	block_bits get_block( bool p, int32_t b ) const {
+		return block_bits( words[4*b+2*p] ) | ( block_bits( words[4*b+2*p+1] ) << 64 );
+	}
+	void set_block( bool p, int32_t b, block_bits v ) {
+		words[4*b+2*p] = uint64_t( v );
+		words[4*b+2*p+1] = uint64_t( v >> 64 );
+	}
+#endif
+	bool operator==( const memo_table& other ) const {
+		return words == other.words;
+	}
+	memo_table() : words( bit_count / 64, 0 ) {}
+};
+
+memo_table memo;
 
 bool fill_memo( int32_t index, board b, bool p ) {
 	assert( is_sane(b) );
 	// check order
 	if( is_ordered( b ) )
-		return memo[p][index] = ORDER;
+		return memo.set( p, index, ORDER );
 	// check chaos
 	if( is_full( b ) )
-		return memo[p][index] = CHAOS;
+		return memo.set( p, index, CHAOS );
 	// pass
-	if( CAN_PASS and p == CHAOS and memo[ORDER][index] == CHAOS )
-		return memo[p][index] = CHAOS;
+	if( CAN_PASS and p == CHAOS and memo.get( ORDER, index ) == CHAOS )
+		return memo.set( p, index, CHAOS );
 	// play
 	for( int i = 0; i < 16; ++i )
 		if( can_move_on_board( b, i ) )
 			for( int j = 0; j < 2; ++j )
-				if( memo[!p][move_on_index(index,i,j)] == p )
-					return memo[p][index] = p;
-	return memo[p][index] = !p;
+				if( memo.get( !p, move_on_index(index,i,j) ) == p )
+					return memo.set( p, index, p );
+	return memo.set( p, index, !p );
 }
 
 void fill_all_memo() {
+	PERF_REGION( scalar, "scalar solver" );
 	for( int32_t index = _3pow16-1; index >= 0; --index ) {
 		board b = index_to_board( index );
 		fill_memo( index, b, ORDER ); // should be done first since chaos can pass
@@ -130,6 +132,417 @@ void fill_all_memo() {
 	}
 }
 
+// Number of plies until the game ends under optimal play: the winner takes the
+// fastest win, the loser the longest resistance. Without passing a game lasts at
+// most 16 plies; when CHAOS may pass every ORDER ply can be preceded by a pass.
+constexpr int depth_bits = CAN_PASS ? 6 : 5;
+
+// Depths packed depth_bits per entry, the entries of both players of an index
+// adjacent. On disk: a header of three words (magic, depth_bits, index count)
+// followed by the packed words.
+class depth_table {
+	static constexpr uint64_t magic = 0x315754445f43564f; // "OVC_DTW1"
+	static constexpr uint64_t entry_mask = ( uint64_t( 1 ) << depth_bits ) - 1;
+	std::vector<uint64_t> words;
+public:
+	int get( bool p, int32_t index ) const {
+		int64_t k = ( 2*int64_t( index ) + p ) * depth_bits;
+		uint64_t w = words[k >> 6] >> ( k & 63 );
+		if( ( k & 63 ) + depth_bits > 64 )
+			w |= words[( k >> 6 ) + 1] << ( 64 - ( k & 63 ) );
+		return w & entry_mask;
+	}
+	int set( bool p, int32_t index, int d ) {
+		assert( d >= 0 and uint64_t( d ) <= entry_mask );
+		int64_t k = ( 2*int64_t( index ) + p ) * depth_bits;
+		words[k >> 6] = ( words[k >> 6] & ~( entry_mask << ( k & 63 ) ) ) | ( uint64_t( d ) << ( k & 63 ) );
+		if( ( k & 63 ) + depth_bits > 64 ) {
+			int shift = 64 - ( k & 63 );
+			words[( k >> 6 ) + 1] = ( words[( k >> 6 ) + 1] & ~( entry_mask >> shift ) ) | ( uint64_t( d ) >> shift );
+		}
+		return d;
+	}
+	bool save( const char* filename ) const {
+		std::ofstream file( filename, std::ios::binary );
+		uint64_t header[3] = { magic, depth_bits, _3pow16 };
+		file.write( reinterpret_cast<const char*>( header ), sizeof( header ) );
+		file.write( reinterpret_cast<const char*>( words.data() ), 8 * words.size() );
+		return bool( file );
+	}
+	bool load( const char* filename ) {
+		std::ifstream file( filename, std::ios::binary );
+		uint64_t header[3];
+		if( not file.read( reinterpret_cast<char*>( header ), sizeof( header ) ) )
+			return false;
+		if( header[0] != magic or header[1] != depth_bits or header[2] != _3pow16 )
+			return false;
+		return bool( file.read( reinterpret_cast<char*>( words.data() ), 8 * words.size() ) );
+	}
+	depth_table() : words( ( 2*int64_t( _3pow16 ) * depth_bits + 63 ) / 64 + 1, 0 ) {}
+};
+
+// Same as fill_memo, but looks at every option to also find the depth.
+bool fill_memo_depth( depth_table& depth, int32_t index, board b, bool p ) {
+	if( is_ordered( b ) ) {
+		depth.set( p, index, 0 );
+		return memo.set( p, index, ORDER );
+	}
+	if( is_full( b ) ) {
+		depth.set( p, index, 0 );
+		return memo.set( p, index, CHAOS );
+	}
+	int win = 64, loss = 0;
+	if( CAN_PASS and p == CHAOS ) {
+		int d = depth.get( ORDER, index ) + 1;
+		if( memo.get( ORDER, index ) == CHAOS )
+			win = std::min( win, d );
+		else
+			loss = std::max( loss, d );
+	}
+	for( int i = 0; i < 16; ++i ) {
+		if( can_move_on_board( b, i ) ) {
+			for( int j = 0; j < 2; ++j ) {
+				int32_t child = move_on_index( index, i, j );
+				int d = depth.get( !p, child ) + 1;
+				if( memo.get( !p, child ) == p )
+					win = std::min( win, d );
+				else
+					loss = std::max( loss, d );
+			}
+		}
+	}
+	if( win < 64 ) {
+		depth.set( p, index, win );
+		return memo.set( p, index, p );
+	}
+	depth.set( p, index, loss );
+	return memo.set( p, index, !p );
+}
+
+void fill_all_memo_depth( depth_table& depth ) {
+	for( int32_t index = _3pow16-1; index >= 0; --index ) {
+		board b = index_to_board( index );
+		fill_memo_depth( depth, index, b, ORDER );
+		fill_memo_depth( depth, index, b, CHAOS );
+	}
+}
+
+constexpr int pass_move = -1;
+
+// An optimal move for p on b according to the memo and depth tables, encoded as
+// cell + 16*symbol, or pass_move.
+int optimal_move( const depth_table& depth, board b, bool p ) {
+	int32_t index = board_to_index( b );
+	bool wins = memo.get( p, index ) == p;
+	int best = pass_move, best_depth = wins ? 64 : -1;
+	if( CAN_PASS and p == CHAOS and ( memo.get( ORDER, index ) == p ) == wins ) {
+		best_depth = depth.get( ORDER, index );
+	}
+	for( int i = 0; i < 16; ++i ) {
+		if( can_move_on_board( b, i ) ) {
+			for( int j = 0; j < 2; ++j ) {
+				int32_t child = move_on_index( index, i, j );
+				if( ( memo.get( !p, child ) == p ) != wins )
+					continue;
+				int d = depth.get( !p, child );
+				if( wins ? d < best_depth : d > best_depth ) {
+					best_depth = d;
+					best = i + 16*j;
+				}
+			}
+		}
+	}
+	return best;
+}
+
+#if MEMO_LAYOUT == 2
+typedef memo_table::block_bits block_bits;
+
+constexpr int32_t block_count = _3pow16 / 81;
+constexpr block_bits block_mask = ( block_bits( 1 ) << 81 ) - 1;
+
+// Masks over the 81 offsets of a block, i.e. over the contents of cells 0-3.
+struct block_table {
+	block_bits empty[4];       // cell i is empty
+	block_bits layer[5];       // exactly k of the cells 0-3 are empty
+	block_bits line[win_line_count][2]; // the part of win line i in cells 0-3 is all O (0) or all X (1)
+	block_table() : empty(), layer(), line() {
+		for( int o = 0; o < 81; ++o ) {
+			board b = index_to_board( o );
+			block_bits bit = block_bits( 1 ) << o;
+			int k = 0;
+			for( int i = 0; i < 4; ++i ) {
+				if( can_move_on_board( b, i ) ) {
+					empty[i] |= bit;
+					k++;
+				}
+			}
+			layer[k] |= bit;
+			for( int i = 0; i < win_line_count; ++i )
+				for( int c = 0; c < 2; ++c )
+					if( ( ( b >> 16*c ) & win_line[i] & 0xf ) == ( win_line[i] & 0xf ) )
+						line[i][c] |= bit;
+		}
+	}
+};
+
+// Rules for passing: nobody passes, CHAOS may pass, ORDER may pass.
+enum pass_rule { NO_PASS, CHAOS_PASSES, ORDER_PASSES };
+constexpr int pass_rule_count = 3;
+
+// Ordered and full masks of a block.
+void block_terminals( const block_table& t, board hb, block_bits& ordered, block_bits& full ) {
+	ordered = 0;
+	for( int i = 0; i < win_line_count; ++i )
+		for( int c = 0; c < 2; ++c )
+			if( ( ( hb >> 16*c ) & win_line[i] & ~0xf ) == ( win_line[i] & ~0xf ) )
+				ordered |= t.line[i][c];
+	full = ( popcount( hb ) == 12 ) ? t.layer[0] : 0;
+}
+
+// Solves the block of 81 positions that differ only in cells 0-3 with bitwise
+// operations on whole blocks. Children through cells 4-15 live in other, already
+// solved blocks and are passed in as order_wins / chaos_wins; children through
+// cells 0-3 live in the same block at a higher offset and are resolved layer by
+// layer, fewest empty cells first.
+template<pass_rule rule>
+void solve_block( const block_table& t, block_bits ordered, block_bits full, block_bits order_wins, block_bits chaos_wins, block_bits& order, block_bits& chaos ) {
+	order = chaos = 0;
+	for( int k = 0; k < 5; ++k ) {
+		block_bits ow = order_wins, cw = chaos_wins;
+		for( int i = 0; i < 4; ++i ) {
+			for( int j = 0; j < 2; ++j ) {
+				int d = ( j+1 ) * ternary.pow3[i];
+				ow |= ( chaos >> d ) & t.empty[i];
+				cw |= ( ( ~order & block_mask ) >> d ) & t.empty[i];
+			}
+		}
+		block_bits o, c;
+		if( rule == ORDER_PASSES ) {
+			c = ordered | ( ~full & ~cw );
+			o = ordered | ( ~full & ( ow | c ) );
+		} else {
+			o = ordered | ( ~full & ow );
+			block_bits passes = rule == CHAOS_PASSES ? ~o : 0;
+			c = ordered | ( ~full & ~passes & ~cw );
+		}
+		order |= o & t.layer[k];
+		chaos |= c & t.layer[k];
+	}
+	order &= block_mask;
+	chaos &= block_mask;
+}
+
+void fill_memo_block( const block_table& t, int32_t block ) {
+	board hb = index_to_board( block*81 );
+	block_bits ordered, full;
+	block_terminals( t, hb, ordered, full );
+	// moves on cells 4-15
+	block_bits order_wins = 0, chaos_wins = 0;
+	for( int i = 4; i < 16; ++i ) {
+		if( can_move_on_board( hb, i ) ) {
+			for( int j = 0; j < 2; ++j ) {
+				int32_t child = block + ( j+1 ) * ternary.pow3[i-4];
+				order_wins |= memo.get_block( CHAOS, child );
+				chaos_wins |= ~memo.get_block( ORDER, child );
+			}
+		}
+	}
+	block_bits order, chaos;
+	solve_block<CAN_PASS ? CHAOS_PASSES : NO_PASS>( t, ordered, full, order_wins, chaos_wins, order, chaos );
+	memo.set_block( ORDER, block, order );
+	memo.set_block( CHAOS, block, chaos );
+}
+
+void fill_all_memo_wide() {
+	static const block_table t;
+	PERF_REGION( wide, "block kernel" );
+	for( int32_t block = block_count-1; block >= 0; --block )
+		fill_memo_block( t, block );
+}
+
+// Results of all pass rules. A block holds the ORDER and CHAOS bits of every rule,
+// so one load of a child block serves all of them. On disk: a header of three
+// words (magic, rule count, block count) followed by the blocks.
+class variant_table {
+	static constexpr uint64_t magic = 0x315241565f43564f; // "OVC_VAR1"
+	static constexpr int block_words = 4 * pass_rule_count;
+	std::vector<uint64_t> words;
+public:
+	block_bits get_block( int rule, bool p, int32_t b ) const {
+		const uint64_t* w = &words[block_words*b + 4*rule + 2*p];
+		return block_bits( w[0] ) | ( block_bits( w[1] ) << 64 );
+	}
+	void set_block( int rule, bool p, int32_t b, block_bits v ) {
+		uint64_t* w = &words[block_words*b + 4*rule + 2*p];
+		w[0] = uint64_t( v );
+		w[1] = uint64_t( v >> 64 );
+	}
+	bool get( int rule, bool p, int32_t index ) const {
+		return ( get_block( rule, p, index / 81 ) >> ( index % 81 ) ) & 1;
+	}
+	bool set( int rule, bool p, int32_t index, bool v ) {
+		block_bits bit = block_bits( 1 ) << ( index % 81 );
+		block_bits w = get_block( rule, p, index / 81 );
+		set_block( rule, p, index / 81, v ? ( w | bit ) : ( w & ~bit ) );
+		return v;
+	}
+	bool operator==( const variant_table& other ) const {
+		return words == other.words;
+	}
+	bool save( const char* filename ) const {
+		std::ofstream file( filename, std::ios::binary );
+		uint64_t header[3] = { magic, pass_rule_count, block_count };
+		file.write( reinterpret_cast<const char*>( header ), sizeof( header ) );
+		file.write( reinterpret_cast<const char*>( words.data() ), 8 * words.size() );
+		return bool( file );
+	}
+	bool load( const char* filename ) {
+		std::ifstream file( filename, std::ios::binary );
+		uint64_t header[3];
+		if( not file.read( reinterpret_cast<char*>( header ), sizeof( header ) ) )
+			return false;
+		if( header[0] != magic or header[1] != pass_rule_count or header[2] != block_count )
+			return false;
+		return bool( file.read( reinterpret_cast<char*>( words.data() ), 8 * words.size() ) );
+	}
+	variant_table() : words( int64_t( block_count ) * block_words, 0 ) {}
+};
+
+// Solves all pass rules in one sweep: the terminal masks are shared and every
+// child block is loaded once for all rules.
+void fill_variant_block( const block_table& t, variant_table& vt, int32_t block ) {
+	board hb = index_to_board( block*81 );
+	block_bits ordered, full;
+	block_terminals( t, hb, ordered, full );
+	block_bits order_wins[pass_rule_count] = {}, chaos_wins[pass_rule_count] = {};
+	for( int i = 4; i < 16; ++i ) {
+		if( can_move_on_board( hb, i ) ) {
+			for( int j = 0; j < 2; ++j ) {
+				int32_t child = block + ( j+1 ) * ternary.pow3[i-4];
+				for( int rule = 0; rule < pass_rule_count; ++rule ) {
+					order_wins[rule] |= vt.get_block( rule, CHAOS, child );
+					chaos_wins[rule] |= ~vt.get_block( rule, ORDER, child );
+				}
+			}
+		}
+	}
+	block_bits order, chaos;
+	solve_block<NO_PASS>( t, ordered, full, order_wins[NO_PASS], chaos_wins[NO_PASS], order, chaos );
+	vt.set_block( NO_PASS, ORDER, block, order );
+	vt.set_block( NO_PASS, CHAOS, block, chaos );
+	solve_block<CHAOS_PASSES>( t, ordered, full, order_wins[CHAOS_PASSES], chaos_wins[CHAOS_PASSES], order, chaos );
+	vt.set_block( CHAOS_PASSES, ORDER, block, order );
+	vt.set_block( CHAOS_PASSES, CHAOS, block, chaos );
+	solve_block<ORDER_PASSES>( t, ordered, full, order_wins[ORDER_PASSES], chaos_wins[ORDER_PASSES], order, chaos );
+	vt.set_block( ORDER_PASSES, ORDER, block, order );
+	vt.set_block( ORDER_PASSES, CHAOS, block, chaos );
+}
+
+void fill_all_variants( variant_table& vt ) {
+	static const block_table t;
+	for( int32_t block = block_count-1; block >= 0; --block )
+		fill_variant_block( t, vt, block );
+}
+
+// Scalar reference for a single rule, used to check fill_all_variants.
+bool fill_memo_variant( variant_table& vt, int rule, int32_t index, board b, bool p ) {
+	if( is_ordered( b ) )
+		return vt.set( rule, p, index, ORDER );
+	if( is_full( b ) )
+		return vt.set( rule, p, index, CHAOS );
+	if( rule == CHAOS_PASSES and p == CHAOS and vt.get( rule, ORDER, index ) == CHAOS )
+		return vt.set( rule, p, index, CHAOS );
+	if( rule == ORDER_PASSES and p == ORDER and vt.get( rule, CHAOS, index ) == ORDER )
+		return vt.set( rule, p, index, ORDER );
+	for( int i = 0; i < 16; ++i )
+		if( can_move_on_board( b, i ) )
+			for( int j = 0; j < 2; ++j )
+				if( vt.get( rule, !p, move_on_index(index,i,j) ) == p )
+					return vt.set( rule, p, index, p );
+	return vt.set( rule, p, index, !p );
+}
+
+void fill_all_variants_scalar( variant_table& vt ) {
+	for( int32_t index = _3pow16-1; index >= 0; --index ) {
+		board b = index_to_board( index );
+		for( int rule = 0; rule < pass_rule_count; ++rule ) {
+			// the player who may pass needs the other result first
+			bool first = rule == ORDER_PASSES ? CHAOS : ORDER;
+			fill_memo_variant( vt, rule, index, b, first );
+			fill_memo_variant( vt, rule, index, b, !first );
+		}
+	}
+}
+#endif
+
+// Direct mapped model of a cache with 64 byte lines, fed with the bit addresses
+// the solver touches. Only used to compare memo layouts.
+struct cache_model {
+	std::vector<int64_t> tags;
+	int64_t accesses = 0, misses = 0;
+	void access( int64_t bit ) {
+		int64_t line = bit >> 9;
+		int64_t& tag = tags[line % tags.size()];
+		accesses++;
+		if( tag != line ) {
+			tag = line;
+			misses++;
+		}
+	}
+	cache_model( int64_t bytes ) : tags( bytes / 64, -1 ) {}
+};
+
+// Replays the table accesses of fill_all_memo on the finished table.
+void replay_memo( cache_model& cache ) {
+	for( int32_t index = _3pow16-1; index >= 0; --index ) {
+		board b = index_to_board( index );
+		for( int k = 0; k < 2; ++k ) {
+			bool p = k == 0 ? ORDER : CHAOS;
+			if( is_ordered( b ) or is_full( b ) ) {
+				cache.access( memo_table::bit( p, index ) );
+				continue;
+			}
+			if( CAN_PASS and p == CHAOS ) {
+				cache.access( memo_table::bit( ORDER, index ) );
+				if( memo.get( ORDER, index ) == CHAOS ) {
+					cache.access( memo_table::bit( p, index ) );
+					continue;
+				}
+			}
+			bool found = false;
+			for( int i = 0; i < 16 and not found; ++i )
+				if( can_move_on_board( b, i ) )
+					for( int j = 0; j < 2 and not found; ++j ) {
+						cache.access( memo_table::bit( !p, move_on_index(index,i,j) ) );
+						found = memo.get( !p, move_on_index(index,i,j) ) == p;
+					}
+			cache.access( memo_table::bit( p, index ) );
+		}
+	}
+}
+
+#if MEMO_LAYOUT == 2
+// Replays the table accesses of fill_all_memo_wide, one per half block loaded
+// or stored.
+void replay_memo_wide( cache_model& cache ) {
+	for( int32_t block = block_count-1; block >= 0; --block ) {
+		board hb = index_to_board( block*81 );
+		for( int i = 4; i < 16; ++i ) {
+			if( can_move_on_board( hb, i ) ) {
+				for( int j = 0; j < 2; ++j ) {
+					int32_t child = block + ( j+1 ) * ternary.pow3[i-4];
+					cache.access( memo_table::bit( CHAOS, child*81 ) );
+					cache.access( memo_table::bit( ORDER, child*81 ) );
+				}
+			}
+		}
+		cache.access( memo_table::bit( ORDER, block*81 ) );
+		cache.access( memo_table::bit( CHAOS, block*81 ) );
+	}
+}
+#endif
+
 void print_board( board b ) {
 	for( int i = 0; i < 16; ++i ) {
 		if( b & (1<<i) )
@@ -144,14 +557,94 @@ void print_board( board b ) {
 }
 
 
-int main() {
+int main( int argc, char* argv[] ) {
+	std::string mode = argc > 1 ? argv[1] : "";
 	assert( conversion_correct() );
 	std::cout << "Computing..." << std::endl;
-	fill_all_memo();
+#if MEMO_LAYOUT == 2
+	if( mode == "variants" ) {
+		variant_table* vt = new variant_table();
+		auto start = std::chrono::steady_clock::now();
+		fill_all_variants( *vt );
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << "All pass rules solved in " << elapsed.count() << "s" << std::endl;
+		const char* rule_name[pass_rule_count] = { "no pass", "CHAOS passes", "ORDER passes" };
+		for( int rule = 0; rule < pass_rule_count; ++rule )
+			std::cout << "  " << rule_name[rule] << ": " << ( vt->get( rule, ORDER, 0 ) ? "ORDER" : "CHAOS" ) << " wins as first player" << std::endl;
+		int result = 0;
+		if( argc > 2 and std::string( argv[2] ) == "check" ) {
+			variant_table* scalar = new variant_table();
+			fill_all_variants_scalar( *scalar );
+			std::cout << "Scalar reference " << ( *scalar == *vt ? "identical" : "DIFFERENT" ) << std::endl;
+			result = *scalar == *vt ? 0 : 1;
+			delete scalar;
+		} else {
+			vt->save( "variants.bin" );
+		}
+		delete vt;
+		return result;
+	}
+#endif
+	auto start = std::chrono::steady_clock::now();
+	depth_table* depth = nullptr;
+	if( mode == "depth" ) {
+		depth = new depth_table();
+		fill_all_memo_depth( *depth );
+	} else {
+#if MEMO_LAYOUT == 2
+		fill_all_memo_wide();
+#else
+		fill_all_memo();
+#endif
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	perf_report( std::cout );
+#if MEMO_LAYOUT == 2
+	if( mode == "check" ) {
+		memo_table wide = memo;
+		memo = memo_table();
+		start = std::chrono::steady_clock::now();
+		fill_all_memo();
+		std::chrono::duration<double> scalar = std::chrono::steady_clock::now() - start;
+		std::cout << "Block kernel " << elapsed.count() << "s, scalar " << scalar.count() << "s, " << ( wide == memo ? "identical" : "DIFFERENT" ) << std::endl;
+		perf_report( std::cout );
+		return wide == memo ? 0 : 1;
+	}
+#endif
+	if( mode == "bench" ) {
+		std::cout << "Layout " << MEMO_LAYOUT << ": " << ( memo_table::bit_count / 8 ) << " bytes, solved in " << elapsed.count() << "s by the "
+				<< ( MEMO_LAYOUT == 2 ? "block kernel" : "scalar solver" ) << std::endl;
+		for( int64_t size : { int64_t( 1 ) << 15, int64_t( 1 ) << 20, int64_t( 1 ) << 25 } ) {
+			// the accesses of the solver that was timed
+			cache_model cache( size );
+#if MEMO_LAYOUT == 2
+			replay_memo_wide( cache );
+#else
+			replay_memo( cache );
+#endif
+			std::cout << "  " << ( size >> 10 ) << "KB cache: " << cache.misses << "/" << cache.accesses << " misses (" << ( 100.0 * cache.misses / cache.accesses ) << "%)" << std::endl;
+		}
+		return 0;
+	}
 	std::cout << "Writing..." << std::endl;
 	std::ofstream p1("order.txt");
-	p1 << memo[ORDER];
+	memo.write( p1, ORDER );
 	std::ofstream p2("chaos.txt");
-	p2 << memo[CHAOS];
+	memo.write( p2, CHAOS );
+	if( depth ) {
+		depth->save( "depth.bin" );
+		// optimal game from the empty board
+		board b = 0;
+		bool p = ORDER;
+		std::cout << ( memo.get( ORDER, 0 ) == ORDER ? "ORDER" : "CHAOS" ) << " wins in " << depth->get( ORDER, 0 ) << " plies" << std::endl;
+		while( not is_ordered( b ) and not is_full( b ) ) {
+			int m = optimal_move( *depth, b, p );
+			if( m != pass_move )
+				b = move_on_board( b, m & 15, m >> 4 );
+			std::cout << ( p == ORDER ? "ORDER" : "CHAOS" ) << ( m == pass_move ? " passes" : " plays" ) << std::endl;
+			print_board( b );
+			p = !p;
+		}
+		delete depth;
+	}
 }
-
@@ -2,7 +2,13 @@
 #include <iostream>
 #include <bitset>
 #include <vector>
-#include <map>
+#include <string>
+#include <algorithm>
+#include <utility>
+#include <thread>
+#include <cstdlib>
+#include "perf_counters.h"
+#include "board_4x4.h"
 
 #define popcount __builtin_popcount
 
@@ -11,73 +17,8 @@
 
 using namespace std;
 
-typedef uint32_t board;
-
-constexpr int32_t _3pow16 = 43046721;
-constexpr int32_t win_line_count = 10;
-constexpr board win_line[win_line_count] = {
-	0b1000100010001000,
-	0b0100010001000100,
-	0b0010001000100010,
-	0b0001000100010001,
-	0b1111000000000000,
-	0b0000111100000000,
-	0b0000000011110000,
-	0b0000000000001111,
-	0b1000010000100001,
-	0b0001001001001000
-};
-
 bitset<_3pow16> order_win;
 
-constexpr bool is_ordered( board b ) {
-	bool v = false;
-	for( int c = 0; c < 2; ++c ) {
-		#pragma unroll
-		for( int i = 0; i < win_line_count; ++i )
-			v |= ( ( b & win_line[i] ) == win_line[i] );
-		if( v )
-			return true;
-		b >>= 16;
-	}
-	return false;
-}
-
-constexpr bool is_full( board b ) {
-	return popcount( b ) == 16;
-}
-
-constexpr bool is_done( board b ) {
-	for( int i = 0; i < win_line_count; ++i ) {
-		if( ( b & win_line[i] ) and ( ( b >> 16 ) & win_line[i] ) )
-			continue;
-		return false;
-	}
-	return true;
-}
-
-constexpr board index_to_board( int32_t index ) {
-	board r = 0;
-	int digit = 0;
-	for( int i = 0; i < 16; ++i ) {
-		digit = index % 3;
-		index /= 3;
-		r |= ( digit & 1 ) << i;
-		r |= ( digit >> 1 ) << (i+16);
-	}
-	return r;
-}
-
-constexpr int32_t board_to_index( board b ) {
-	int32_t index = 0;
-	int digit = 0;
-	for( int i = 15; i >= 0; --i ) {
-		digit = ( (b>>i) & 1 ) + 2*( (b>>(i+16)) & 1 );
-		index = 3*index+digit;
-	}
-	return index;
-}
-
 void print_board( board b ) {
 	for( int i = 0; i < 16; ++i ) {
 		if( b & (1<<i) )
@@ -91,47 +32,7 @@ void print_board( board b ) {
 	}
 }
 
-constexpr board toggle( board b ) {
-	return ( b << 16 ) | ( b >> 16 );
-}
-
-constexpr board mirror( board b ) {
-	board s = b & 0b10001000100010001000100010001000;
-	board t = b & 0b01000100010001000100010001000100;
-	board u = b & 0b00100010001000100010001000100010;
-	board v = b & 0b00010001000100010001000100010001;
-	return (s >> 3) | (t >> 1) | (u << 1) | (v << 3);
-}
-
-constexpr board rotate( board b ) {
-	return 
-	 (( b & 0b10000000000000001000000000000000 ) >> 3  )
-	|(( b & 0b01000000000000000100000000000000 ) >> 6  )
-	|(( b & 0b00100000000000000010000000000000 ) >> 9  )
-	|(( b & 0b00010000000000000001000000000000 ) >> 12 )
-	|(( b & 0b00001000000000000000100000000000 ) << 2  )
-	|(( b & 0b00000100000000000000010000000000 ) >> 1  )
-	|(( b & 0b00000010000000000000001000000000 ) >> 4  )
-	|(( b & 0b00000001000000000000000100000000 ) >> 7  )
-	|(( b & 0b00000000100000000000000010000000 ) << 7  )
-	|(( b & 0b00000000010000000000000001000000 ) << 4  )
-	|(( b & 0b00000000001000000000000000100000 ) << 1  )
-	|(( b & 0b00000000000100000000000000010000 ) >> 2  )
-	|(( b & 0b00000000000010000000000000001000 ) << 12 )
-	|(( b & 0b00000000000001000000000000000100 ) << 9  )
-	|(( b & 0b00000000000000100000000000000010 ) << 6  )
-	|(( b & 0b00000000000000010000000000000001 ) << 3  );
-}
-
-constexpr board invert( board b ) {
-	return 
-	 (( b & 0b10100000101000001010000010100000 ) >> 5  )
-	|(( b & 0b01010000010100000101000001010000 ) >> 3  )
-	|(( b & 0b00001010000010100000101000001010 ) << 3  )
-	|(( b & 0b00000101000001010000010100000101 ) << 5  );
-}
-
-constexpr board canonical( board b ) {
+constexpr board canonical_slow( board b ) {
 	board c = b;
 	for( int s = 0; s < 2; ++s ) {
 		for( int t = 0; t < 2; ++t ) {
@@ -150,18 +51,54 @@ constexpr board canonical( board b ) {
 	return c;
 }
 
-bitset<_3pow16> order_data;
+// all hardware threads unless given on the command line
+int thread_count = max( 1u, thread::hardware_concurrency() );
+
+// Splits [begin,end) into one contiguous range per thread and calls f( t, lo, hi ).
+template<typename F>
+void parallel_for( int32_t begin, int32_t end, F f ) {
+	vector<thread> threads;
+	int32_t step = ( end - begin + thread_count - 1 ) / thread_count;
+	for( int t = 0; t < thread_count; ++t ) {
+		int32_t lo = min( end, begin + t*step );
+		int32_t hi = min( end, lo + step );
+		threads.emplace_back( f, t, lo, hi );
+	}
+	for( thread& th : threads )
+		th.join();
+}
+
+bool canonical_correct() {
+	vector<char> ok( thread_count, true );
+	parallel_for( 0, _3pow16, [&]( int t, int32_t lo, int32_t hi ) {
+		PERF_REGION( canonical, "canonicalization" );
+		for( int32_t i = lo; i < hi; ++i ) {
+			board b = index_to_board( i );
+			auto ct = canonical_transform( b );
+			if( ct.first != canonical_slow( b ) or apply_symmetry( b, ct.second ) != ct.first ) {
+				ok[t] = false;
+				return;
+			}
+		}
+	} );
+	return count( ok.begin(), ok.end(), false ) == 0;
+}
 
 template<board (*T)(board)>
 bool test_operation() {
-	for( int32_t i = 0; i < _3pow16; ++i ) {
-		board b = index_to_board( i );
-		board c = T( b );
-		int32_t j = board_to_index( c );
-		if( order_data.test( i ) != order_data.test( j ) )
-			return false;
-	}
-	return true;
+	vector<char> ok( thread_count, true );
+	parallel_for( 0, _3pow16, [&]( int t, int32_t lo, int32_t hi ) {
+		for( int32_t i = lo; i < hi; ++i ) {
+			board b = index_to_board( i );
+			board c = T( b );
+			int32_t j = board_to_index( c );
+			if( order_win.test( i ) != order_win.test( j ) ) {
+				ok[t] = false;
+				return;
+			}
+		}
+	} );
+	return count( ok.begin(), ok.end(), false ) == 0;
 }
 
 bool test_operations() {
@@ -169,19 +106,50 @@ bool test_operations() {
 	return test_operation<toggle>() && test_operation<mirror>() && test_operation<rotate>() && test_operation<invert>();
 }
 
-int main() {
-	cout << "Reading win data..." << endl << boolalpha;
-	ifstream order_data("order.txt");
-	order_data >> order_win;
-	order_data.close();
+// Writes a .npy file (format 1.0) whose leading dimension is only known at the end.
+// The header is padded to a fixed size so it can be patched in place on close.
+class npy_writer {
+	ofstream file;
+	string descr;
+	string trailing_shape;
+	int64_t rows;
+	static constexpr int header_size = 128;
+	void write_header() {
+		string dict = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': (" + to_string( rows ) + "," + trailing_shape + "), }";
+		string header = "\x93NUMPY";
+		header += char( 1 );
+		header += char( 0 );
+		header += char( ( header_size - 10 ) & 0xff );
+		header += char( ( header_size - 10 ) >> 8 );
+		header += dict;
+		header.resize( header_size - 1, ' ' );
+		header += '\n';
+		file.seekp( 0 );
+		file.write( header.data(), header.size() );
+	}
+public:
+	void write( const char* data, size_t row_count, size_t row_size ) {
+		file.write( data, row_count * row_size );
+		rows += row_count;
+	}
+	void close() {
+		write_header();
+		file.close();
+	}
+	npy_writer( const char* filename, string d, string t ) : file( filename, ios::binary ), descr( d ), trailing_shape( t ), rows( 0 ) {
+		write_header();
+	}
+};
 
-	assert( test_operations() );
-	
-	cout << "Writing JSON..." << endl;
-	ofstream json_data("order.json");
-	json_data << "{ \"data\" : [\n";
-	bool first = true;
-	for( int32_t i = 0; i < _3pow16; ++i ) {
+// Number of indices handled per chunk; one chunk per thread of output is buffered.
+constexpr int32_t chunk_size = 1 << 20;
+
+// Appends the dataset rows for indices [lo,hi) to the given buffers.
+void export_range( int32_t lo, int32_t hi, vector<char>& data_chunk, vector<char>& target_chunk ) {
+	PERF_REGION( export, "export" );
+	data_chunk.clear();
+	target_chunk.clear();
+	for( int32_t i = lo; i < hi; ++i ) {
 		board b = index_to_board( i );
 		if( is_ordered( b ) )
 			continue;
@@ -189,45 +157,51 @@ int main() {
 			continue;
 		if( b != canonical( b ) )
 			continue;
-		board c = b;
 
-		if( first )
-			first = false;
-		else
-			json_data << ",\n";
-
-		json_data << "[";
-		for( int i = 0; i < 16; ++i ) {
-			if( i != 0 )
-				json_data << ",";
-			if( c & 0b0000000000000001 )
-				json_data << "0";
-			else if( c & 0b10000000000000000 )
-				json_data << "2";
-			else
-				json_data << "1";
-			c >>= 1;
-		}
-		json_data << "]";
+		// 0 = O, 1 = empty, 2 = X, the same encoding the JSON export used
+		for( int j = 0; j < 16; ++j )
+			data_chunk.push_back( ( b >> j ) & 1 ? 0 : ( ( b >> ( j+16 ) ) & 1 ? 2 : 1 ) );
+		target_chunk.push_back( -1+2*order_win.test(i) );
 	}
-	json_data << "\n], \"target\" : [\n";
+}
 
-	first = true;
-	for( int32_t i = 0; i < _3pow16; ++i ) {
-		board b = index_to_board( i );
-		if( is_ordered( b ) )
-			continue;
-		if( is_done( b ) )
-			continue;
-		if( b != canonical( b ) )
-			continue;
+int main( int argc, char* argv[] ) {
+	// filter.exe [--verify] [threads]
+	bool verify = argc > 1 and string( argv[1] ) == "--verify";
+	if( argc > 1 + verify )
+		thread_count = max( 1, atoi( argv[1 + verify] ) );
 
-		if( first )
-			first = false;
-		else
-			json_data << ",\n";
+	cout << "Reading win data..." << endl << boolalpha;
+	ifstream order_data("order.txt");
+	order_data >> order_win;
+	order_data.close();
 
-		json_data << ( -1+2*order_win.test(i) );
+	if( verify ) {
+		bool ok = test_operations();
+		cout << "Symmetries preserve the result: " << ok << endl;
+		bool cok = canonical_correct();
+		cout << "Canonical tables agree: " << cok << endl;
+		perf_report( cout );
+		if( not ok or not cok )
+			return 1;
 	}
-	json_data << "\n]}\n";
-}
\ No newline at end of file
+	
+	cout << "Writing dataset..." << endl;
+	npy_writer data( "order_data.npy", "|u1", " 16" );
+	npy_writer target( "order_target.npy", "|i1", "" );
+	// every thread fills its own chunk, the chunks are written in index order
+	vector<vector<char>> data_chunk( thread_count ), target_chunk( thread_count );
+	for( int32_t start = 0; start < _3pow16; start += thread_count * chunk_size ) {
+		int32_t end = min( start + thread_count * chunk_size, _3pow16 );
+		parallel_for( start, end, [&]( int t, int32_t lo, int32_t hi ) {
+			export_range( lo, hi, data_chunk[t], target_chunk[t] );
+		} );
+		for( int t = 0; t < thread_count; ++t ) {
+			data.write( data_chunk[t].data(), target_chunk[t].size(), 16 );
+			target.write( target_chunk[t].data(), target_chunk[t].size(), 1 );
+		}
+	}
+	data.close();
+	target.close();
+	perf_report( cout );
+}
@@ -0,0 +1,108 @@
+// Binary records of self-play games, for training data without text parsing.
+//
+// A file is a sequence of games, each a game_header followed by move_count
+// move_records; both are fixed size and little endian as written by the machine.
+// Every game repeats the rules in its header, so files of one configuration can
+// simply be concatenated. Moves are encoded as in the engines, symbol*board_s +
+// cell, with 2*board_s for a pass.
+//
+//   game_record_writer out( "games.bin" );  // appends
+//   out.begin_game( header );
+//   out.add_move( { move, turn, 0, root_visits, move_visits, value } );
+//   out.end_game( winner );
+//
+//   game_record_reader in( "games.bin" );
+//   while( in.next( header, moves ) ) ...
+//
+// The writer keeps the moves of the game in progress in memory and hands a game
+// to the stream only when it is over, so an interrupted run leaves whole games
+// (at most the last one cut short, which the reader stops at).
+#ifndef GAME_RECORD_H
+#define GAME_RECORD_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct game_header {
+	char magic[8];
+	int16_t width, line;
+	uint8_t can_pass, pass_player, first_turn, winner;
+	uint32_t seed; // the engine's PRNG is seeded with it before the game
+	uint32_t move_count;
+	static constexpr char expected_magic[8] = { 'O', 'V', 'C', '_', 'G', 'A', 'M', 'E' };
+	game_header() {
+		memset( this, 0, sizeof( *this ) );
+		memcpy( magic, expected_magic, 8 );
+	}
+	bool valid() const { return memcmp( magic, expected_magic, 8 ) == 0; }
+};
+
+// One move with the root statistics of the search that chose it. value is the
+// win rate of the chosen move for the player who made it.
+struct move_record {
+	int16_t move;
+	uint8_t turn;
+	uint8_t flags;
+	uint32_t root_visits;
+	uint32_t move_visits;
+	float value;
+	static constexpr uint8_t from_book = 1;
+};
+
+static_assert( sizeof( game_header ) == 24, "game_header must have no padding" );
+static_assert( sizeof( move_record ) == 16, "move_record must have no padding" );
+
+constexpr char game_header::expected_magic[8];
+
+class game_record_writer {
+	std::vector<char> buffer;
+	std::ofstream file;
+	game_header header;
+	std::vector<move_record> moves;
+public:
+	explicit game_record_writer( const std::string& filename, size_t buffer_size = 1 << 20 ) : buffer( buffer_size ) {
+		file.rdbuf()->pubsetbuf( buffer.data(), std::streamsize( buffer.size() ) );
+		file.open( filename, std::ios::binary | std::ios::app );
+	}
+	bool is_open() const { return file.is_open(); }
+	void begin_game( const game_header& h ) {
+		header = h;
+		moves.clear();
+	}
+	void add_move( const move_record& m ) { moves.push_back( m ); }
+	bool end_game( int winner ) {
+		header.winner = uint8_t( winner );
+		header.move_count = uint32_t( moves.size() );
+		file.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+		file.write( reinterpret_cast<const char*>( moves.data() ), std::streamsize( moves.size() * sizeof( move_record ) ) );
+		moves.clear();
+		return bool( file );
+	}
+	bool flush() { return bool( file.flush() ); }
+};
+
+class game_record_reader {
+	std::vector<char> buffer;
+	std::ifstream file;
+public:
+	explicit game_record_reader( const std::string& filename, size_t buffer_size = 1 << 20 ) : buffer( buffer_size ) {
+		file.rdbuf()->pubsetbuf( buffer.data(), std::streamsize( buffer.size() ) );
+		file.open( filename, std::ios::binary );
+	}
+	bool is_open() const { return file.is_open(); }
+	// the next whole game, false at the end of the file or at a damaged record
+	bool next( game_header& h, std::vector<move_record>& moves ) {
+		if( not file.read( reinterpret_cast<char*>( &h ), sizeof( h ) ) or not h.valid() )
+			return false;
+		// a game has at most one move per cell and symbol and a pass
+		if( h.width <= 0 or h.move_count > 2 * uint32_t( h.width ) * uint32_t( h.width ) + 1 )
+			return false;
+		moves.resize( h.move_count );
+		return bool( file.read( reinterpret_cast<char*>( moves.data() ), std::streamsize( moves.size() * sizeof( move_record ) ) ) );
+	}
+};
+
+#endif
@@ -5,6 +5,8 @@
 #include <map>
 #include <vector>
 #include <cmath>
+#include <thread>
+#include "game_record.h"
 
 // #define NDEBUG
 #include <cassert>
@@ -72,33 +74,53 @@ struct next_moves {
 
 template<uint64_t n> struct exp3 { static const uint64_t result = 3*exp3<n-1>::result; };
 template<> struct exp3<0> { static const uint64_t result = 1; };
+// The boards with indices in [first, last), of all 3^board_s boards. Cell k holds
+// trit k of the index: 0 is empty, 1 is 1 and 2 is -1. The iterator steps its
+// board like a ternary odometer, so a step costs O(1) amortized; only the start
+// of a range is converted from its index.
 struct all_boards {
+	static constexpr uint64_t count = exp3<board_s>::result;
 	class iterator {
 		uint64_t i;
+		board b;
 	public:
-		board operator*() const {
-			board b;
-			uint64_t j = i, k = 0;
-			const int v[3] = { 0, 1, -1 };
-			while( j ) {
-				b.sq[k++] = v[j % 3];
-				j /= 3;
-			}
-			return b;
-		}
+		const board& operator*() const { return b; }
+		uint64_t index() const { return i; }
 		void advance() {
 			++i;
-			if( i >= exp3<board_s>::result )
-				i = -1;
+			for( int k = 0; k < board_s; ++k ) {
+				int& v = b.sq[k];
+				if( v == 0 ) {
+					v = 1;
+					return;
+				}
+				if( v == 1 ) {
+					v = -1;
+					return;
+				}
+				v = 0; // carry into the next cell
+			}
+		}
+		iterator& operator++() { advance(); return *this; }
+		iterator operator++(int) { iterator itr = *this; advance(); return itr; }
+		bool operator==( const iterator& other ) const { return i == other.i; }
+		bool operator!=( const iterator& other ) const { return i != other.i; }
+		// an end iterator only needs its index
+		iterator( uint64_t start, bool with_board = true ) : i( start ) {
+			const int v[3] = { 0, 1, -1 };
+			for( int k = 0; with_board and k < board_s; ++k, start /= 3 )
+				b.sq[k] = v[start % 3];
 		}
-		iterator operator++() { iterator itr = *this; advance(); return itr; }
-		iterator operator++(int) { advance(); return *this; }
-		bool operator==( iterator other ) { return i == other.i; }
-		bool operator!=( iterator other ) { return i != other.i; }
-		iterator( uint64_t start ) { i = start; }
 	};
-	iterator begin() const { return iterator(0); }
-	iterator end() const { return iterator(-1); }
+	uint64_t first, last;
+	iterator begin() const { return iterator( first ); }
+	iterator end() const { return iterator( last, false ); }
+	uint64_t size() const { return last - first; }
+	// chunk k of n nearly equal parts of the range
+	all_boards chunk( int k, int n ) const {
+		return all_boards( first + uint64_t( ( unsigned __int128 )( size() ) * k / n ), first + uint64_t( ( unsigned __int128 )( size() ) * ( k+1 ) / n ) );
+	}
+	all_boards( uint64_t f = 0, uint64_t l = count ) : first( f ), last( l ) {}
 };
 
 class monte_carlo_tree_search {
@@ -119,6 +141,8 @@ public:
 private:
 	node* root;
 public:
+	// if set, simulate appends every move with its root statistics
+	game_record_writer* record;
 	history select( board& b, bool turn ) const;
 	void back_propagate( const history& h, bool turn, bool winner );
 	bool play_out( board b, bool turn ) const;
@@ -482,7 +506,17 @@ bool monte_carlo_tree_search::simulate( board b, bool turn, int dives ) {
 				std::cout << "\n";
 			}
 		}
-		assert( root->get_best_explored_child<best_score_function>( b, turn ) != nullptr );
+		board before = b;
+		node* choice = root->get_best_explored_child<best_score_function>( b, turn );
+		assert( choice != nullptr );
+		if( record ) {
+			int move = board_pass;
+			for( int i = 0; i < board_s; ++i )
+				if( before.sq[i] != b.sq[i] )
+					move = ( b.sq[i] < 0 ) * board_s + i;
+			record->add_move( { int16_t( move ), uint8_t( turn ), 0, uint32_t( root->rate.first ), uint32_t( choice->rate.first ),
+				float( best_score_function( choice->rate, root->rate ) ) } );
+		}
 		turn = !turn;
 
 		if( false ) { // printing
@@ -554,6 +588,7 @@ void monte_carlo_tree_search::clear() {
 
 monte_carlo_tree_search::monte_carlo_tree_search() {
 	root = new node();
+	record = nullptr;
 }
 
 monte_carlo_tree_search::~monte_carlo_tree_search() {
@@ -561,12 +596,70 @@ monte_carlo_tree_search::~monte_carlo_tree_search() {
 		delete root;
 }
 
-int main() {
+// Counts the ordered, disordered and open boards of the whole space, every thread
+// sweeping its own chunk.
+void board_statistics( int thread_count ) {
+	std::vector<uint64_t> counts( 3*thread_count, 0 );
+	std::vector<std::thread> threads;
+	all_boards space;
+	for( int t = 0; t < thread_count; ++t ) {
+		threads.emplace_back( [&counts, &space, t, thread_count]() {
+			// counted locally, the slots of neighbouring threads share cache lines
+			uint64_t local[3] = { 0, 0, 0 };
+			for( const board& b : space.chunk( t, thread_count ) )
+				local[1 + b.is_game_over()]++;
+			for( int j = 0; j < 3; ++j )
+				counts[3*t + j] = local[j];
+		} );
+	}
+	for( std::thread& th : threads )
+		th.join();
+	uint64_t total[3] = { 0, 0, 0 };
+	for( int t = 0; t < thread_count; ++t )
+		for( int j = 0; j < 3; ++j )
+			total[j] += counts[3*t + j];
+	std::cout << all_boards::count << " boards: " << total[2] << " ordered, " << total[0] << " disordered, " << total[1] << " open" << std::endl;
+}
+
+int main( int argc, char* argv[] ) {
+	if( argc > 1 and std::string( argv[1] ) == "stats" ) {
+		board_statistics( argc > 2 ? atoi( argv[2] ) : int( std::thread::hardware_concurrency() ) );
+		return 0;
+	}
+	// record <file>: also appends the games with their moves to a game record file
+	game_record_writer* out = nullptr;
+	if( argc > 2 and std::string( argv[1] ) == "record" ) {
+		out = new game_record_writer( argv[2] );
+		if( not out->is_open() ) {
+			std::cout << "Cannot open " << argv[2] << std::endl;
+			return 1;
+		}
+	}
 	int rc = 0;
 	for( int i = 0; i < 100; ++i ) {
 		std::cout << "Game " << i << std::endl;
 		monte_carlo_tree_search tree;
-		rc += tree.simulate( board(), ORDER, board_d );
+		tree.record = out;
+		bool winner;
+		if( out ) {
+			game_header h;
+			h.width = board_w;
+			h.line = board_m;
+			h.can_pass = CAN_PASS;
+			h.pass_player = CHAOS;
+			h.first_turn = ORDER;
+			// the recorded game is replayed by seeding rand() with h.seed; glibc
+			// treats 0 as 1, so the seeds start at 1
+			h.seed = uint32_t( i ) + 1;
+			srand( h.seed );
+			out->begin_game( h );
+			winner = tree.simulate( board(), ORDER, board_d );
+			out->end_game( winner );
+		} else {
+			winner = tree.simulate( board(), ORDER, board_d );
+		}
+		rc += winner;
 		std::cout << rc << "/" << (i+1) << std::endl;
 	}
+	delete out;
 }
\ No newline at end of file
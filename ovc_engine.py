@@ -0,0 +1,92 @@
+import ctypes
+
+CHAOS = 0
+ORDER = 1
+
+
+class OvcEngine:
+    """ ctypes wrapper around the C interface of table/ovc.h.
+        Build the library with "make libovc_4x4.so" or "make libovc_6x6.so".
+    """
+
+    def __init__(self, library="./libovc_4x4.so", seed=0):
+        self.lib = ctypes.CDLL(library)
+        self.lib.ovc_search_create.restype = ctypes.c_void_p
+        self.lib.ovc_search_create.argtypes = [ctypes.c_uint]
+        for name in ["ovc_search_destroy", "ovc_game_state", "ovc_best_move"]:
+            getattr(self.lib, name).argtypes = [ctypes.c_void_p]
+        self.lib.ovc_set_position.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_byte), ctypes.c_int]
+        self.lib.ovc_play.argtypes = [ctypes.c_void_p, ctypes.c_int]
+        self.lib.ovc_run_dives.argtypes = [ctypes.c_void_p, ctypes.c_int]
+        self.lib.ovc_run_time.argtypes = [ctypes.c_void_p, ctypes.c_double]
+        self.lib.ovc_root_stats.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int)]
+        self.lib.ovc_save.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+        self.lib.ovc_load.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+        self.lib.ovc_playouts.argtypes = [ctypes.c_void_p, ctypes.c_int]
+        self.width = self.lib.ovc_board_width()
+        self.line_length = self.lib.ovc_line_length()
+        self.move_count = self.lib.ovc_move_count()
+        self.handle = self.lib.ovc_search_create(seed)
+
+    def __del__(self):
+        if getattr(self, "handle", None):
+            self.lib.ovc_search_destroy(self.handle)
+            self.handle = None
+
+    def set_position(self, cells, turn):
+        """ cells: width*width values, 0 = empty, 1 = O, 2 = X, row by row """
+        array = (ctypes.c_byte * len(cells))(*cells)
+        if self.lib.ovc_set_position(self.handle, array, turn) != 0:
+            raise ValueError("invalid position")
+
+    def move_index(self, r, c, symbol):
+        """ symbol 1 = O, 2 = X; None for a pass """
+        if symbol is None:
+            return 2 * self.width * self.width
+        return (symbol - 1) * self.width * self.width + r * self.width + c
+
+    def move_tuple(self, move):
+        s = self.width * self.width
+        if move == 2 * s:
+            return None
+        return (move % s) // self.width, move % self.width, 1 + move // s
+
+    def play(self, r, c, symbol):
+        if self.lib.ovc_play(self.handle, self.move_index(r, c, symbol)) != 0:
+            raise ValueError("illegal move")
+
+    def game_state(self):
+        return self.lib.ovc_game_state(self.handle)
+
+    def run_dives(self, dives):
+        return self.lib.ovc_run_dives(self.handle, dives)
+
+    def run_time(self, ms):
+        return self.lib.ovc_run_time(self.handle, ms)
+
+    def root_stats(self):
+        """ {move tuple: (visits, wins for the player to move)} of the explored root moves """
+        visits = (ctypes.c_int * self.move_count)()
+        wins = (ctypes.c_int * self.move_count)()
+        self.lib.ovc_root_stats(self.handle, visits, wins)
+        return dict((self.move_tuple(i), (visits[i], wins[i])) for i in range(self.move_count) if visits[i])
+
+    def best_move(self):
+        move = self.lib.ovc_best_move(self.handle)
+        if move < 0:
+            return None
+        return self.move_tuple(move)
+
+    def save(self, filename):
+        """ checkpoint the search tree with its position """
+        if self.lib.ovc_save(self.handle, filename.encode()) != 0:
+            raise IOError("cannot save " + filename)
+
+    def load(self, filename):
+        """ restore a checkpoint, replacing the position and the tree """
+        if self.lib.ovc_load(self.handle, filename.encode()) != 0:
+            raise IOError("cannot load " + filename)
+
+    def playouts(self, n):
+        """ number of ORDER wins in n random games from the position """
+        return self.lib.ovc_playouts(self.handle, n)
@@ -0,0 +1,170 @@
+// Hardware performance counters for named code regions, from Linux perf_event_open.
+// Compiled in with -DPERF_COUNTERS=1, otherwise PERF_REGION expands to nothing
+// and perf_report prints nothing.
+//
+//   PERF_REGION( playout, "playout" );   // counts until the end of the scope
+//   ...
+//   perf_report( std::cout );
+//
+// Every thread opens its own counter group on first use: cycles, instructions,
+// cache misses and branch misses of user code, read with a single read() on entry
+// and on exit of a region (so a region costs two system calls; keep them coarse
+// or expect the overhead in the numbers). Nested regions are counted in both.
+// Events the kernel refuses (no PMU in a VM, perf_event_paranoid, seccomp) are
+// reported as unavailable; entries and wall time are always reported.
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#ifndef PERF_COUNTERS
+#define PERF_COUNTERS 0
+#endif
+
+#include <ostream>
+
+#if PERF_COUNTERS
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+constexpr int perf_event_count = 4;
+constexpr const char* perf_event_name[perf_event_count] = { "cycles", "instructions", "cache-misses", "branch-misses" };
+constexpr uint64_t perf_event_config[perf_event_count] = {
+	PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+
+// The counters of the calling thread. Events that could not be opened read as 0.
+class perf_group {
+	int leader = -1;
+	int fd[perf_event_count];
+	int index[perf_event_count]; // position in the group read, -1 if unavailable
+	int opened = 0;
+public:
+	int error = 0; // errno of the first failed event
+	perf_group() {
+		for( int e = 0; e < perf_event_count; ++e ) {
+			index[e] = fd[e] = -1;
+			perf_event_attr attr;
+			memset( &attr, 0, sizeof( attr ) );
+			attr.size = sizeof( attr );
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = perf_event_config[e];
+			attr.read_format = PERF_FORMAT_GROUP;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.disabled = leader < 0;
+			fd[e] = int( syscall( __NR_perf_event_open, &attr, 0, -1, leader, 0 ) );
+			if( fd[e] < 0 ) {
+				if( not error )
+					error = errno;
+				continue;
+			}
+			if( leader < 0 )
+				leader = fd[e];
+			index[e] = opened++;
+		}
+		if( leader >= 0 ) {
+			ioctl( leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP );
+			ioctl( leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+		}
+	}
+	~perf_group() {
+		for( int e = 0; e < perf_event_count; ++e )
+			if( fd[e] >= 0 )
+				close( fd[e] );
+	}
+	bool available( int e ) const { return index[e] >= 0; }
+	void read_counts( uint64_t* counts ) const {
+		uint64_t buffer[1 + perf_event_count] = {};
+		if( leader < 0 or read( leader, buffer, sizeof( buffer ) ) <= 0 )
+			buffer[0] = 0;
+		for( int e = 0; e < perf_event_count; ++e )
+			counts[e] = index[e] >= 0 and index[e] < int( buffer[0] ) ? buffer[1 + index[e]] : 0;
+	}
+	static perf_group& local() {
+		thread_local perf_group group;
+		return group;
+	}
+};
+
+struct perf_region {
+	const char* name;
+	std::atomic<uint64_t> counts[perf_event_count];
+	std::atomic<uint64_t> entries, nanoseconds;
+	explicit perf_region( const char* n ) : name( n ), counts(), entries( 0 ), nanoseconds( 0 ) {
+		std::lock_guard<std::mutex> lock( mutex() );
+		all().push_back( this );
+	}
+	static std::vector<perf_region*>& all() {
+		static std::vector<perf_region*> regions;
+		return regions;
+	}
+	static std::mutex& mutex() {
+		static std::mutex m;
+		return m;
+	}
+};
+
+class perf_scope {
+	perf_region& region;
+	uint64_t start[perf_event_count];
+	std::chrono::steady_clock::time_point start_time;
+public:
+	explicit perf_scope( perf_region& r ) : region( r ) {
+		start_time = std::chrono::steady_clock::now();
+		perf_group::local().read_counts( start );
+	}
+	~perf_scope() {
+		uint64_t end[perf_event_count];
+		perf_group::local().read_counts( end );
+		for( int e = 0; e < perf_event_count; ++e )
+			region.counts[e] += end[e] - start[e];
+		region.entries++;
+		region.nanoseconds += uint64_t( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start_time ).count() );
+	}
+	perf_scope( const perf_scope& ) = delete;
+	perf_scope& operator=( const perf_scope& ) = delete;
+};
+
+#define PERF_REGION( id, name ) \
+	static perf_region perf_region_##id( name ); \
+	perf_scope perf_scope_##id( perf_region_##id )
+
+inline void perf_report( std::ostream& os ) {
+	const perf_group& group = perf_group::local();
+	if( group.error )
+		os << "perf: counters unavailable (" << strerror( group.error ) << ")" << std::endl;
+	std::lock_guard<std::mutex> lock( perf_region::mutex() );
+	for( const perf_region* r : perf_region::all() ) {
+		uint64_t n = r->entries;
+		if( n == 0 )
+			continue;
+		os << "perf " << r->name << ": " << n << " entries, " << std::fixed << std::setprecision( 3 ) << r->nanoseconds * 1e-9 << "s";
+		for( int e = 0; e < perf_event_count; ++e ) {
+			if( group.available( e ) )
+				os << ", " << perf_event_name[e] << " " << r->counts[e];
+			else
+				os << ", " << perf_event_name[e] << " n/a";
+		}
+		if( group.available( 0 ) and group.available( 1 ) and r->counts[0] )
+			os << ", IPC " << std::setprecision( 2 ) << double( r->counts[1] ) / double( r->counts[0] );
+		os << std::defaultfloat << std::endl;
+	}
+}
+
+#else
+
+#define PERF_REGION( id, name )
+
+inline void perf_report( std::ostream& ) {}
+
+#endif
+
+#endif
@@ -0,0 +1,251 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <bitset>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+// Arrow tilings of the N x N torus without a SAT solver.
+//
+//   exact_cover [N] [count|first|all] [threads]
+//
+// The problem of sat_generator.cc as an exact cover: each of the 4N lines takes
+// exactly one domino of its direction, and no two dominoes share a cell. Any
+// satisfying assignment of the CNF contains such a set (drop the extra dominoes
+// of a line), so both have solutions for the same N; for N = 8 they are the same
+// perfect tilings. As in the CNF the domino to the right of (0, 0) is fixed, and
+// every tiling has N horizontal dominoes that a translation can move there, so
+// there are N times as many tilings in all.
+//
+// The search repeatedly takes the line (or for N = 8 the cell) with the fewest
+// dominoes that still fit and tries each of them, with the used cells in a
+// bitset. The top levels are expanded into tasks that the threads take in turn.
+// Solutions are printed as "v <variables> 0" lines in the numbering of
+// sat_generator, which visual reads.
+
+const int dx[4] = { -1, 0, 1, 1 };
+const int dy[4] = { 1, 1, 1, 0 };
+
+const int max_n = 32;
+// choices expanded before the tasks are handed to the threads
+const int split_depth = 4;
+
+typedef std::bitset<max_n*max_n> cells;
+
+struct option {
+	int variable, line, a, b; // sat_generator variable, its line and the two cells
+};
+
+struct state {
+	cells used;
+	std::bitset<4*max_n> done; // per line
+	std::vector<int> chosen; // variables
+	// per option the number of placed dominoes that rule it out, and per line
+	// and cell the number of options that still fit
+	std::vector<int> blocked, line_fit, cell_fit;
+};
+
+class tiling_search {
+	int N;
+	std::vector<option> options;
+	std::vector<std::vector<int>> lines; // the options of each line
+	std::vector<std::vector<int>> cell_options; // the options covering each cell
+	// with N = 8 the 4N dominoes cover every cell, so cells are items to cover
+	// as well and the search may branch on the cell with the fewest options
+	bool cover_cells;
+	std::mutex print_mutex;
+public:
+	enum mode_t { COUNT, FIRST, ALL } mode;
+	std::atomic<bool> stop;
+
+	tiling_search( int n, mode_t m ) : N( n ), lines( 4*n ), cell_options( n*n ), cover_cells( 8*n == n*n ), mode( m ), stop( false ) {
+		for( int d = 0; d < 4; ++d ) {
+			for( int x = 0; x < N; ++x ) {
+				int sx = x, sy = 0;
+				if( d == 3 )
+					std::swap( sx, sy );
+				for( int i = 0; i < N; ++i ) {
+					int vx = ( sx + i*dx[d] + N ) % N;
+					int vy = ( sy + i*dy[d] + N ) % N;
+					int nx = ( vx + dx[d] + N ) % N;
+					int ny = ( vy + dy[d] + N ) % N;
+					option o = { d*N*N + N*vx + vy + 1, d*N + x, N*vx + vy, N*nx + ny };
+					lines[o.line].push_back( int( options.size() ) );
+					cell_options[o.a].push_back( int( options.size() ) );
+					cell_options[o.b].push_back( int( options.size() ) );
+					options.push_back( o );
+				}
+			}
+		}
+	}
+
+	state initial() const {
+		state s;
+		s.blocked.assign( options.size(), 0 );
+		s.line_fit.assign( 4*N, N );
+		s.cell_fit.assign( N*N, 8 );
+		// symmetry breaking: the first domino of row 0 starts at (0, 0)
+		place( s, options[lines[N][0]] );
+		return s;
+	}
+
+	void block( state& s, int k ) const {
+		if( s.blocked[k]++ == 0 ) {
+			const option& o = options[k];
+			s.line_fit[o.line]--;
+			s.cell_fit[o.a]--;
+			s.cell_fit[o.b]--;
+		}
+	}
+	void unblock( state& s, int k ) const {
+		if( --s.blocked[k] == 0 ) {
+			const option& o = options[k];
+			s.line_fit[o.line]++;
+			s.cell_fit[o.a]++;
+			s.cell_fit[o.b]++;
+		}
+	}
+	// the counts are kept up to date incrementally: placing a domino rules out
+	// the other options of its line and its two cells
+	void place( state& s, const option& o ) const {
+		s.done[o.line] = true;
+		s.used.set( o.a );
+		s.used.set( o.b );
+		s.chosen.push_back( o.variable );
+		for( int k : lines[o.line] )
+			block( s, k );
+		for( int k : cell_options[o.a] )
+			block( s, k );
+		for( int k : cell_options[o.b] )
+			block( s, k );
+	}
+	void remove( state& s, const option& o ) const {
+		for( int k : cell_options[o.b] )
+			unblock( s, k );
+		for( int k : cell_options[o.a] )
+			unblock( s, k );
+		for( int k : lines[o.line] )
+			unblock( s, k );
+		s.chosen.pop_back();
+		s.used.reset( o.a );
+		s.used.reset( o.b );
+		s.done[o.line] = false;
+	}
+
+	// the options of the open line or uncovered cell with the fewest fitting
+	// options; false if all lines are done
+	bool choose( const state& s, const std::vector<int>*& choice ) const {
+		int fitting = N+1;
+		choice = nullptr;
+		for( int l = 0; l < 4*N and fitting; ++l ) {
+			if( not s.done[l] and s.line_fit[l] < fitting ) {
+				fitting = s.line_fit[l];
+				choice = &lines[l];
+			}
+		}
+		for( int c = 0; cover_cells and choice and c < N*N and fitting; ++c ) {
+			if( not s.used[c] and s.cell_fit[c] < fitting ) {
+				fitting = s.cell_fit[c];
+				choice = &cell_options[c];
+			}
+		}
+		return choice != nullptr;
+	}
+
+	void print( const state& s ) {
+		std::lock_guard<std::mutex> lock( print_mutex );
+		if( mode == FIRST ) {
+			// another thread may have found one at the same time
+			if( stop )
+				return;
+			stop = true;
+			std::cout << "s SATISFIABLE\n";
+		}
+		std::cout << "v";
+		for( int v : s.chosen )
+			std::cout << " " << v;
+		std::cout << " 0\n";
+	}
+
+	// counts the completions of s
+	uint64_t search( state& s ) {
+		if( stop )
+			return 0;
+		const std::vector<int>* choice;
+		if( not choose( s, choice ) ) {
+			if( mode != COUNT )
+				print( s );
+			return 1;
+		}
+		uint64_t count = 0;
+		for( int k : *choice ) {
+			const option& o = options[k];
+			if( s.blocked[k] )
+				continue;
+			place( s, o );
+			count += search( s );
+			remove( s, o );
+		}
+		return count;
+	}
+
+	// the states depth choices below s, or s itself if it is complete
+	void expand( const state& s, int depth, std::vector<state>& tasks ) const {
+		const std::vector<int>* choice;
+		if( depth == 0 or not choose( s, choice ) ) {
+			tasks.push_back( s );
+			return;
+		}
+		for( int k : *choice ) {
+			if( s.blocked[k] )
+				continue;
+			state t = s;
+			place( t, options[k] );
+			expand( t, depth-1, tasks );
+		}
+	}
+
+	uint64_t run( int thread_count ) {
+		std::vector<state> tasks;
+		expand( initial(), split_depth, tasks );
+		std::atomic<size_t> next( 0 );
+		std::vector<uint64_t> counts( thread_count, 0 );
+		std::vector<std::thread> threads;
+		for( int t = 0; t < thread_count; ++t ) {
+			threads.emplace_back( [this, &tasks, &next, &counts, t]() {
+				for( size_t k; ( k = next++ ) < tasks.size(); )
+					counts[t] += search( tasks[k] );
+			} );
+		}
+		for( std::thread& th : threads )
+			th.join();
+		uint64_t total = 0;
+		for( uint64_t c : counts )
+			total += c;
+		return total;
+	}
+};
+
+int main( int argc, char* argv[] ) {
+	const int N = argc > 1 ? atoi( argv[1] ) : 8;
+	const std::string mode = argc > 2 ? argv[2] : "count";
+	const int threads = argc > 3 ? atoi( argv[3] ) : std::max( 1, int( std::thread::hardware_concurrency() ) );
+	if( N < 3 or N > max_n or ( mode != "count" and mode != "first" and mode != "all" ) ) {
+		std::cerr << "Usage: exact_cover [3 <= N <= " << max_n << "] [count|first|all] [threads]" << std::endl;
+		return 1;
+	}
+	std::ios::sync_with_stdio( false );
+	tiling_search search( N, mode == "count" ? tiling_search::COUNT : mode == "first" ? tiling_search::FIRST : tiling_search::ALL );
+	uint64_t count = search.run( threads );
+	if( mode == "first" ) {
+		if( count == 0 )
+			std::cout << "s UNSATISFIABLE" << std::endl;
+	} else {
+		std::cout << "c " << count << " tilings with the domino right of (0, 0), " << N*count << " in all" << std::endl;
+	}
+	return 0;
+}
@@ -1,56 +1,113 @@
 #include <iostream>
 #include <vector>
+#include <string>
 #include <utility>
+#include <cstdlib>
+
+// Arrow tilings of the N x N torus as CNF.
+//
+//   sat_generator [N] [pairwise|ladder]
+//
+// Variable d*N*N + N*x + y + 1 places a domino from cell (x, y) to its neighbour
+// in direction d (up-right, right, down-right, down). Every line of the torus in
+// each of the four directions holds a domino of that direction, and every cell
+// lies in at most one domino; for N = 8 that forces a perfect tiling with exactly
+// one domino per line. The at-most-one constraints are pairwise, or with ladder
+// a sequential counter with 7 extra variables and 20 instead of 28 clauses per
+// cell. A translation of the torus maps tilings to tilings and moves any domino
+// onto any cell, so the domino to the right of (0, 0) is fixed.
 
 const int dx[8] = { -1, 0, 1, 1, 1, 0, -1, -1 };
 const int dy[8] = { 1, 1, 1, 0, -1, -1, -1, 0 };
 
-typedef std::pair<int,int> ii;
 typedef std::vector<int> vi;
 
-int adj[8][8][8];
-ii edges[64*4];
+// Writes clauses straight to the stream, one write per clause, so no formula is
+// kept in memory; the header needs the totals up front.
+class dimacs_writer {
+	std::ostream& os;
+	std::string line;
+public:
+	dimacs_writer( std::ostream& o, int variables, long clauses ) : os( o ) {
+		os << "p cnf " << variables << " " << clauses << "\n";
+	}
+	~dimacs_writer() { os.flush(); }
+	void clause( const vi& literals ) {
+		line.clear();
+		for( int l : literals ) {
+			line += std::to_string( l );
+			line += ' ';
+		}
+		line += "0\n";
+		os << line;
+	}
+};
+
+int main( int argc, char* argv[] ) {
+	const int N = argc > 1 ? atoi( argv[1] ) : 8;
+	const bool ladder = argc > 2 and std::string( argv[2] ) == "ladder";
+	std::ios::sync_with_stdio( false );
+	if( N < 3 ) {
+		std::cerr << "Usage: sat_generator [N >= 3] [pairwise|ladder]" << std::endl;
+		return 1;
+	}
 
-int main() {
+	// adj[cell][d] is the edge leaving the cell in direction d, or entering it from direction d-4
+	std::vector<vi> adj( N*N, vi( 8 ) );
 	int nedg = 0;
 	for( int d = 0; d < 4; ++d ) {
-		for( int x = 0; x < 8; ++x ) {
-			for( int y = 0; y < 8; ++y ) {
-				int nx = (x + dx[d] + 8) % 8;
-				int ny = (y + dy[d] + 8) % 8;
-				adj[ x][ y][  d] = nedg;
-				adj[nx][ny][4+d] = nedg;
-				edges[nedg++] = ii( 8*x + y, 8*nx + ny );
+		for( int x = 0; x < N; ++x ) {
+			for( int y = 0; y < N; ++y ) {
+				int nx = (x + dx[d] + N) % N;
+				int ny = (y + dy[d] + N) % N;
+				adj[ N*x + y][  d] = nedg;
+				adj[N*nx + ny][4+d] = nedg;
+				nedg++;
 			}
 		}
 	}
 
-	std::cout << "p cnf " << ( 64*4 ) << " " << ( 8*4 + 8*8*8*7/2 ) << std::endl;
+	const int variables = nedg + ( ladder ? N*N*7 : 0 );
+	const long clauses = 4*N + 1 + long( N*N ) * ( ladder ? 20 : 28 );
+	dimacs_writer out( std::cout, variables, clauses );
 
 	for( int d = 0; d < 4; ++d ) {
-		for( int x = 0; x < 8; ++x ) {
+		for( int x = 0; x < N; ++x ) {
 			int sx = x, sy = 0;
-			if( d == 3 ) 
+			if( d == 3 )
 				std::swap(sx, sy);
 
 			vi constr;
-			for( int i = 0; i < 8; ++i ) {
-				int vx = (sx + i*dx[d] + 8) % 8;
-				int vy = (sy + i*dy[d] + 8) % 8;
-				constr.push_back( adj[vx][vy][d] );
+			for( int i = 0; i < N; ++i ) {
+				int vx = (sx + i*dx[d] + N) % N;
+				int vy = (sy + i*dy[d] + N) % N;
+				constr.push_back( adj[N*vx + vy][d] + 1 );
 			}
-
-			for( int x : constr ) 
-				std::cout << (x+1) << " ";
-			std::cout << " 0\n";
+			out.clause( constr );
 		}
 	}
 
-	for( int x = 0; x < 8; ++x )
-		for( int y = 0; y < 8; ++y )
+	// symmetry breaking
+	out.clause( { adj[0][1] + 1 } );
+
+	int aux = nedg;
+	for( int c = 0; c < N*N; ++c ) {
+		if( ladder ) {
+			// s[i] is true if one of the first i+1 edges is
+			int s = aux + 1;
+			aux += 7;
+			for( int i = 0; i < 7; ++i )
+				out.clause( { -( adj[c][i] + 1 ), s+i } );
+			for( int i = 1; i < 7; ++i )
+				out.clause( { -( s+i-1 ), s+i } );
+			for( int i = 1; i < 8; ++i )
+				out.clause( { -( adj[c][i] + 1 ), -( s+i-1 ) } );
+		} else {
 			for( int d = 0; d < 8; ++d )
 				for( int e = 0; e < d; ++e )
-					std::cout << "-" << ( adj[x][y][d] + 1 ) << " -" << ( adj[x][y][e] + 1 ) << " 0\n";
-	
+					out.clause( { -( adj[c][d] + 1 ), -( adj[c][e] + 1 ) } );
+		}
+	}
+
 	return 0;
 }
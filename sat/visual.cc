@@ -1,37 +1,52 @@
 #include <iostream>
 #include <string>
+#include <vector>
+#include <cstdlib>
+
+// Draws the arrow tilings of a solver output for the N x N torus (default 8),
+// one grid per model: picosat prints a single model, exact_cover one per line.
+// Cells without a domino are drawn as dots.
 
 const int dx[4] = { -1, 0, 1, 1 };
 const int dy[4] = { 1, 1, 1, 0 };
 const std::string arrow[] = { "↗", "→", "↘", "↓" , "↙", "←", "↖", "↑" };
 
-int main() {
-	int G[8][8];
+int main( int argc, char* argv[] ) {
+	const int N = argc > 1 ? atoi( argv[1] ) : 8;
+	std::vector<int> G( N*N, -1 );
 	std::string S;
+	bool first = true;
 	while( std::cin >> S ) {
-		if( S[0] == 's' or S[0] == 'S' or S[0] == 'v' or S[0] == '0' )
+		if( S == "0" ) {
+			// end of a model
+			if( not first )
+				std::cout << std::endl;
+			first = false;
+			for( int i = 0; i < N; ++i ) {
+				for( int j = 0; j < N; ++j )
+					std::cout << ( G[N*i + j] < 0 ? "·" : arrow[G[N*i + j]] ) << " ";
+				std::cout << std::endl;
+			}
+			G.assign( N*N, -1 );
+			continue;
+		}
+		if( S[0] == 's' or S[0] == 'S' or S[0] == 'v' or S[0] == 'c' )
 			continue;
 
 		int num = stoi( S );
-		if( num > 0 ) {
+		if( num > 0 and num <= 4*N*N ) {
 			num--;
-			int d = num/64;
-			int x = (num%64) / 8;
-			int y = (num%64) % 8;
+			int d = num/(N*N);
+			int x = (num%(N*N)) / N;
+			int y = (num%(N*N)) % N;
 
-			int nx = (x + dx[d] + 8) % 8;
-			int ny = (y + dy[d] + 8) % 8;
+			int nx = (x + dx[d] + N) % N;
+			int ny = (y + dy[d] + N) % N;
 
-			G[x][y]   = d;
-			G[nx][ny] = d+4;   
+			G[N*x + y]   = d;
+			G[N*nx + ny] = d+4;
 		}
 	}
 
-	for( int i = 0; i < 8; ++i ) {
-		for( int j = 0; j < 8; ++j )
-			std::cout << arrow[G[i][j]] << " ";
-		std::cout << std::endl;
-	}
-
 	return 0;
 }
@@ -0,0 +1,444 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+
+#define popcount64 __builtin_popcountll
+#define ctz64 __builtin_ctzll
+
+#define NDEBUG
+#include <cassert>
+
+#define CHAOS 0
+#define ORDER 1
+
+// Exact solver for positions on boards up to 8x8, alpha-beta on win/loss values
+// with iterative deepening and a transposition table keyed by position up to the
+// 16 symmetries of the board (D4 times swapping O and X).
+
+// The following values can be defined via compiler flags, as for mmcts.cc
+#ifndef board_w
+#define board_w 6
+#endif
+#ifndef board_m
+#define board_m 5
+#endif
+#ifndef CAN_PASS
+#define CAN_PASS 1
+#endif
+#ifndef PASS_PLAYER
+#define PASS_PLAYER CHAOS
+#endif
+// log2 of the number of transposition table entries (16 bytes each)
+#ifndef tt_bits
+#define tt_bits 22
+#endif
+
+#define board_h board_w
+#define board_s (board_w*board_h)
+
+static_assert( board_s <= 64, "the bitboards hold at most 64 cells" );
+
+typedef uint64_t bitboard;
+
+// A position: the cells holding O and X and the player to move.
+struct position {
+	bitboard o, x;
+	bool turn;
+};
+
+enum value { CHAOS_WINS = CHAOS, ORDER_WINS = ORDER, UNKNOWN };
+
+constexpr int line_count = 2 * board_h * ( board_w - board_m + 1 ) + 2 * ( board_w - board_m + 1 ) * ( board_h - board_m + 1 );
+constexpr int symmetry_count = 16; // 8 cell permutations, times 2 for swapping O and X
+
+// Masks of all lines of board_m cells, the lines through every cell and the
+// cell permutations of the board symmetries.
+struct line_table {
+	bitboard line[line_count];
+	int cell_lines[board_s][4*board_m];
+	int cell_line_count[board_s];
+	int perm[8][board_s];
+	constexpr line_table() : line(), cell_lines(), cell_line_count(), perm() {
+		const int dr[4] = { 0, 1, 1, 1 };
+		const int dc[4] = { 1, 0, 1, -1 };
+		int n = 0;
+		for( int d = 0; d < 4; ++d ) {
+			for( int r = 0; r < board_h; ++r ) {
+				for( int c = 0; c < board_w; ++c ) {
+					int er = r + dr[d]*( board_m-1 ), ec = c + dc[d]*( board_m-1 );
+					if( er < 0 or er >= board_h or ec < 0 or ec >= board_w )
+						continue;
+					for( int i = 0; i < board_m; ++i ) {
+						int cell = ( r + dr[d]*i ) * board_w + c + dc[d]*i;
+						line[n] |= bitboard( 1 ) << cell;
+						cell_lines[cell][cell_line_count[cell]++] = n;
+					}
+					++n;
+				}
+			}
+		}
+		// k = 4*transpose + 2*flip rows + flip columns
+		for( int k = 0; k < 8; ++k ) {
+			for( int r = 0; r < board_h; ++r ) {
+				for( int c = 0; c < board_w; ++c ) {
+					int rr = k & 2 ? board_h-1-r : r;
+					int cc = k & 1 ? board_w-1-c : c;
+					perm[k][r*board_w+c] = k & 4 ? cc*board_w+rr : rr*board_w+cc;
+				}
+			}
+		}
+	}
+};
+
+constexpr line_table lines;
+
+constexpr bitboard all_cells = board_s == 64 ? ~bitboard( 0 ) : ( bitboard( 1 ) << board_s ) - 1;
+
+bool is_ordered( const position& p ) {
+	for( int i = 0; i < line_count; ++i )
+		if( ( p.o & lines.line[i] ) == lines.line[i] or ( p.x & lines.line[i] ) == lines.line[i] )
+			return true;
+	return false;
+}
+
+
+// One pass over the lines: the cells of the live lines, which CHAOS has won
+// without, and the cells that complete a line with O (threat[0]) or with X
+// (threat[1]). Empty cells outside every live line are dead: a stone there
+// changes nothing but the count of empty cells.
+bitboard scan_lines( const position& p, bitboard threat[2] ) {
+	threat[0] = threat[1] = 0;
+	bitboard live = 0, empty = all_cells & ~( p.o | p.x );
+	for( int i = 0; i < line_count; ++i ) {
+		bitboard l = lines.line[i];
+		bitboard lo = p.o & l, lx = p.x & l;
+		if( lo and lx )
+			continue;
+		live |= l;
+		if( popcount64( lo | lx ) == board_m-1 )
+			threat[lx != 0] |= l & empty;
+	}
+	return live;
+}
+
+position do_move( position p, int cell, bool symbol ) {
+	( symbol ? p.x : p.o ) |= bitboard( 1 ) << cell;
+	p.turn = !p.turn;
+	return p;
+}
+
+position do_pass( position p ) {
+	p.turn = !p.turn;
+	return p;
+}
+
+// Zobrist keys of a position under every symmetry, updated move by move. The
+// smallest of them identifies the symmetry class.
+struct zobrist_table {
+	uint64_t cell[board_s][2];
+	uint64_t turn;
+	zobrist_table() {
+		uint64_t s = 0x9e3779b97f4a7c15;
+		auto next = [&s]() {
+			uint64_t z = ( s += 0x9e3779b97f4a7c15 );
+			z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9;
+			z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111eb;
+			return z ^ ( z >> 31 );
+		};
+		for( int i = 0; i < board_s; ++i )
+			for( int j = 0; j < 2; ++j )
+				cell[i][j] = next();
+		turn = next();
+	}
+};
+
+const zobrist_table zobrist;
+
+struct symmetric_key {
+	uint64_t key[symmetry_count];
+	void clear() {
+		for( int k = 0; k < symmetry_count; ++k )
+			key[k] = 0;
+	}
+	void move( int cell, bool symbol ) {
+		for( int k = 0; k < symmetry_count; ++k )
+			key[k] ^= zobrist.cell[lines.perm[k >> 1][cell]][symbol ^ ( k & 1 )];
+	}
+	uint64_t canonical( bool turn ) const {
+		uint64_t m = key[0];
+		for( int k = 1; k < symmetry_count; ++k )
+			m = key[k] < m ? key[k] : m;
+		return turn ? m ^ zobrist.turn : m;
+	}
+};
+
+symmetric_key key_of( const position& p ) {
+	symmetric_key k;
+	k.clear();
+	for( int i = 0; i < board_s; ++i ) {
+		if( ( p.o >> i ) & 1 )
+			k.move( i, false );
+		if( ( p.x >> i ) & 1 )
+			k.move( i, true );
+	}
+	return k;
+}
+
+// Proven values are kept for good, unknown ones with the depth they were searched
+// to, so a deeper iteration searches them again.
+class transposition_table {
+	struct entry {
+		uint64_t key;
+		uint8_t result;
+		uint8_t depth;
+		uint8_t pad[6];
+	};
+	std::vector<entry> entries;
+public:
+	// empty entries read as unknown to depth 0, which no search accepts
+	transposition_table() : entries( size_t( 1 ) << tt_bits, entry{ 0, UNKNOWN, 0, {} } ) {}
+	bool probe( uint64_t key, int depth, value& v ) const {
+		const entry& e = entries[key & ( entries.size()-1 )];
+		if( e.key != key or ( e.result == UNKNOWN and e.depth < depth ) )
+			return false;
+		v = value( e.result );
+		return true;
+	}
+	void store( uint64_t key, int depth, value v ) {
+		entry& e = entries[key & ( entries.size()-1 )];
+		// keep proofs over unknowns of other positions
+		if( e.key != key and e.key and e.result != UNKNOWN and v == UNKNOWN )
+			return;
+		e.key = key;
+		e.result = uint8_t( v );
+		e.depth = uint8_t( depth );
+	}
+	void clear() {
+		std::fill( entries.begin(), entries.end(), entry{ 0, UNKNOWN, 0, {} } );
+	}
+};
+
+struct move {
+	int cell; // -1 for a pass
+	bool symbol;
+	int score;
+};
+
+// Move ordering: ORDER prefers moves that extend the fullest lines, CHAOS moves
+// that kill the fullest lines.
+int move_score( const position& p, int cell, bool symbol ) {
+	int score = 0;
+	for( int j = 0; j < lines.cell_line_count[cell]; ++j ) {
+		bitboard l = lines.line[lines.cell_lines[cell][j]];
+		int same = popcount64( ( symbol ? p.x : p.o ) & l ), other = popcount64( ( symbol ? p.o : p.x ) & l );
+		if( p.turn == ORDER and other == 0 )
+			score += ( same+1 ) * ( same+1 );
+		else if( p.turn == CHAOS and same == 0 and other > 0 )
+			score += other * other;
+	}
+	return score;
+}
+
+class solver {
+	transposition_table tt;
+public:
+	int64_t nodes = 0;
+	value search( const position& p, const symmetric_key& k, int depth );
+	value solve( const position& p, int& depth, bool print = false );
+	void clear() { tt.clear(); }
+};
+
+// The value of p if it can be proven within depth plies, otherwise UNKNOWN.
+value solver::search( const position& p, const symmetric_key& k, int depth ) {
+	++nodes;
+	bitboard threat[2];
+	bitboard live = scan_lines( p, threat );
+	if( live == 0 )
+		return CHAOS_WINS;
+	if( p.turn == ORDER and ( threat[0] | threat[1] ) )
+		return ORDER_WINS;
+	// CHAOS can block one threat cell by playing the other symbol there, unless
+	// that completes a line as well
+	bitboard blocks = threat[0] | threat[1];
+	if( p.turn == CHAOS and ( popcount64( blocks ) > 1 or ( threat[0] & threat[1] ) ) )
+		return ORDER_WINS;
+	if( depth == 0 )
+		return UNKNOWN;
+	uint64_t key = k.canonical( p.turn );
+	value v;
+	if( tt.probe( key, depth, v ) )
+		return v;
+
+	bool me = p.turn;
+	move moves[2*board_s+2];
+	int n = 0;
+	bitboard empty = all_cells & ~( p.o | p.x );
+	if( blocks ) {
+		int cell = ctz64( blocks );
+		moves[n++] = { cell, bool( threat[0] & blocks ), 0 };
+	} else {
+		bitboard dead = empty & ~live;
+		// all dead cells are alike, try one of them
+		if( dead )
+			moves[n++] = { ctz64( dead ), false, -1 };
+		for( bitboard e = empty & ~dead; e; e &= e-1 ) {
+			int cell = ctz64( e );
+			for( int s = 0; s < 2; ++s )
+				moves[n++] = { cell, bool( s ), move_score( p, cell, s ) };
+		}
+		if( CAN_PASS and p.turn == PASS_PLAYER )
+			moves[n++] = { -1, false, -1 };
+		std::sort( moves, moves+n, []( const move& a, const move& b ) { return a.score > b.score; } );
+	}
+
+	value result = value( !me );
+	for( int i = 0; i < n; ++i ) {
+		const move& m = moves[i];
+		symmetric_key ck = k;
+		position c;
+		if( m.cell < 0 ) {
+			c = do_pass( p );
+		} else {
+			c = do_move( p, m.cell, m.symbol );
+			ck.move( m.cell, m.symbol );
+		}
+		value cv = search( c, ck, depth-1 );
+		if( cv == value( me ) ) {
+			result = cv;
+			break;
+		}
+		if( cv == UNKNOWN )
+			result = UNKNOWN;
+	}
+	tt.store( key, depth, result );
+	return result;
+}
+
+// Deepens the search one ply at a time until the value is proven; sets depth to
+// the depth that proved it.
+value solver::solve( const position& p, int& depth, bool print ) {
+	if( is_ordered( p ) )
+		return ORDER_WINS;
+	int empty = board_s - int( popcount64( p.o | p.x ) );
+	// every move fills a cell and a pass is always followed by a move
+	int max_depth = CAN_PASS ? 2*empty+1 : empty;
+	symmetric_key k = key_of( p );
+	value v = UNKNOWN;
+	auto start = std::chrono::steady_clock::now();
+	for( depth = 1; depth <= max_depth and v == UNKNOWN; ++depth ) {
+		v = search( p, k, depth );
+		if( print ) {
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			std::cout << "depth " << depth << ": " << ( v == UNKNOWN ? "unknown" : v == ORDER_WINS ? "ORDER wins" : "CHAOS wins" )
+				<< ", " << nodes << " nodes, " << elapsed.count() << "s" << std::endl;
+		}
+	}
+	--depth;
+	assert( v != UNKNOWN );
+	return v;
+}
+
+// Plain minimax without pruning, tables or symmetry, for checking on small positions.
+bool order_wins_reference( const position& p ) {
+	if( is_ordered( p ) )
+		return true;
+	bitboard empty = all_cells & ~( p.o | p.x );
+	if( empty == 0 )
+		return false;
+	bool me = p.turn;
+	if( CAN_PASS and p.turn == PASS_PLAYER and order_wins_reference( do_pass( p ) ) == me )
+		return me;
+	for( bitboard e = empty; e; e &= e-1 )
+		for( int s = 0; s < 2; ++s )
+			if( order_wins_reference( do_move( p, ctz64( e ), s ) ) == me )
+				return me;
+	return !me;
+}
+
+bool parse_position( const std::string& cells, const std::string& player, position& p ) {
+	if( int( cells.size() ) != board_s or ( player != "order" and player != "chaos" ) )
+		return false;
+	p.o = p.x = 0;
+	for( int i = 0; i < board_s; ++i ) {
+		if( cells[i] == 'O' )
+			p.o |= bitboard( 1 ) << i;
+		else if( cells[i] == 'X' )
+			p.x |= bitboard( 1 ) << i;
+	}
+	p.turn = player == "order" ? ORDER : CHAOS;
+	return true;
+}
+
+void print_position( const position& p ) {
+	for( int i = 0; i < board_s; ++i ) {
+		std::cout << ( ( p.o >> i ) & 1 ? 'O' : ( p.x >> i ) & 1 ? 'X' : '.' );
+		if( i % board_w == board_w-1 )
+			std::cout << "\n";
+	}
+	std::cout << ( p.turn == ORDER ? "ORDER" : "CHAOS" ) << " to move" << std::endl;
+}
+
+// A position with the given number of empty cells reached by random moves, not
+// yet won by ORDER.
+position random_position( int empty ) {
+	for( ;; ) {
+		position p = { 0, 0, ORDER };
+		while( board_s - popcount64( p.o | p.x ) > empty and not is_ordered( p ) ) {
+			bitboard e = all_cells & ~( p.o | p.x );
+			int n = rand() % popcount64( e );
+			for( int i = 0; i < n; ++i )
+				e &= e-1;
+			p = do_move( p, ctz64( e ), rand() & 1 );
+		}
+		if( not is_ordered( p ) )
+			return p;
+	}
+}
+
+int main( int argc, char* argv[] ) {
+	std::string mode = argc > 1 ? argv[1] : "";
+	solver* s = new solver();
+	if( mode == "random" or mode == "check" ) {
+		if( argc <= 4 ) {
+			std::cout << "Usage: " << mode << " <empty cells> <positions> <seed>" << std::endl;
+			return 1;
+		}
+		int empty = atoi( argv[2] ), count = atoi( argv[3] );
+		srand( unsigned( atoi( argv[4] ) ) );
+		int wins[2] = { 0, 0 }, wrong = 0;
+		auto start = std::chrono::steady_clock::now();
+		for( int i = 0; i < count; ++i ) {
+			position p = random_position( empty );
+			int depth;
+			value v = s->solve( p, depth );
+			wins[v]++;
+			if( mode == "check" and ( v == ORDER_WINS ) != order_wins_reference( p ) ) {
+				print_position( p );
+				wrong++;
+			}
+		}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << count << " positions with " << empty << " empty cells: ORDER wins " << wins[ORDER] << ", CHAOS wins " << wins[CHAOS]
+			<< ", " << s->nodes << " nodes, " << elapsed.count() << "s" << std::endl;
+		if( mode == "check" )
+			std::cout << "Reference solver " << ( wrong ? "DISAGREES" : "agrees" ) << std::endl;
+		delete s;
+		return wrong ? 1 : 0;
+	}
+	position p = { 0, 0, PASS_PLAYER };
+	if( argc > 2 and not parse_position( argv[1], argv[2], p ) ) {
+		std::cout << "Usage: solve.exe [<cells, row by row with . O X> <order|chaos>]" << std::endl;
+		return 1;
+	}
+	print_position( p );
+	int depth;
+	value v = s->solve( p, depth, true );
+	std::cout << ( v == ORDER_WINS ? "ORDER" : "CHAOS" ) << " wins, proven at depth " << depth << std::endl;
+	delete s;
+	return 0;
+}
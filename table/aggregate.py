@@ -0,0 +1,91 @@
+""" Aggregates mmcts results ("winner seed" lines, winner 1 = ORDER, 0 = CHAOS).
+
+    python aggregate.py data/res_*.txt
+        one line per file: games, ORDER wins, win rate and Wilson interval
+    python aggregate.py --decide --looks 10 --alpha 0.05 --max-games 200 data/res_X_*.txt
+        pools the files into one configuration and prints "stop ORDER", "stop CHAOS",
+        "stop undecided" or "continue"
+
+    generate_table.sh looks at the results after every batch of games, so the
+    decision is sequential: each of the planned looks is tested at level
+    alpha/looks (Bonferroni), which keeps the overall error below alpha however
+    many looks are actually taken. A configuration stops as soon as the interval
+    excludes 0.5, or when it reaches max-games.
+"""
+from __future__ import print_function
+import argparse
+import math
+import sys
+
+
+def read_results(filenames):
+    games = order_wins = 0
+    for name in filenames:
+        with open(name) as f:
+            for line in f:
+                fields = line.split()
+                if not fields:
+                    continue
+                games += 1
+                order_wins += int(fields[0]) == 1
+    return games, order_wins
+
+
+def normal_quantile(p):
+    """ inverse of the standard normal distribution function, by bisection """
+    lo, hi = -10.0, 10.0
+    for _ in range(100):
+        mid = (lo + hi) / 2
+        if 0.5 * (1 + math.erf(mid / math.sqrt(2))) < p:
+            lo = mid
+        else:
+            hi = mid
+    return (lo + hi) / 2
+
+
+def wilson_interval(wins, games, alpha):
+    if games == 0:
+        return 0.0, 1.0
+    z = normal_quantile(1 - alpha / 2)
+    p = float(wins) / games
+    denominator = 1 + z * z / games
+    centre = (p + z * z / (2 * games)) / denominator
+    half = z * math.sqrt(p * (1 - p) / games + z * z / (4 * games * games)) / denominator
+    return max(0.0, centre - half), min(1.0, centre + half)
+
+
+def decide(wins, games, alpha, looks, max_games):
+    lo, hi = wilson_interval(wins, games, alpha / looks)
+    if lo > 0.5:
+        return "stop ORDER"
+    if hi < 0.5:
+        return "stop CHAOS"
+    if games >= max_games:
+        return "stop undecided"
+    return "continue"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Win rates and sequential stopping for mmcts results")
+    parser.add_argument("files", nargs="+")
+    parser.add_argument("--decide", action="store_true", help="pool the files and print the stopping decision")
+    parser.add_argument("--alpha", type=float, default=0.05)
+    parser.add_argument("--looks", type=int, default=1, help="planned number of looks at the data")
+    parser.add_argument("--max-games", type=int, default=100)
+    args = parser.parse_args()
+
+    if args.decide:
+        games, wins = read_results(args.files)
+        print(decide(wins, games, args.alpha, args.looks, args.max_games))
+        return 0
+
+    for name in args.files:
+        games, wins = read_results([name])
+        lo, hi = wilson_interval(wins, games, args.alpha)
+        rate = float(wins) / games if games else 0.0
+        print("%s: %d games, %d ORDER wins, %.3f [%.3f, %.3f]" % (name, games, wins, rate, lo, hi))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,363 @@
+""" Hands out mmcts games to workers over TCP or Unix sockets.
+
+    A work unit is one game of one configuration: the engine ./mmcts_<job>
+    (built as in generate_table.sh) run with a seed, and with the opening book
+    data/book_<job>.bin if there is one. Every worker keeps a
+    connection to the coordinator, asks for a unit, renews its lease while the
+    game runs and sends back the engine output. Units whose engine fails, whose
+    lease runs out or whose worker disconnects are handed out again, up to
+    --max-attempts times in all, after which they are reported as failed;
+    duplicate results are dropped.
+
+    python coordinator.py serve --listen tcp:0.0.0.0:5555 --job 1_CHAOS_8_6_100000_n20000:100
+    python coordinator.py work --connect tcp:host:5555 [--slots 8]
+    python coordinator.py local --workers 4 --job 1_CHAOS_4_4_200:20
+
+    Results stream into --output as "<job> <winner> <seed>" lines; a restarted
+    coordinator skips the units already there. When all units are done the
+    results of every job are also written to <engine dir>/data/res_<job>.txt,
+    the format generate_table.sh produces and aggregate.py reads.
+
+    Protocol: one JSON object per line.
+      worker:      {"op": "request"} | {"op": "renew", "unit": u} | {"op": "result", "unit": u, "output": "..."}
+                   | {"op": "fail", "unit": u, "error": "..."}
+      coordinator: {"unit": u, "job": j, "seed": s, "lease": seconds} | {"wait": seconds} | {"done": true} | {"ok": true}
+"""
+from __future__ import print_function
+import argparse
+import json
+import os
+import socket
+import socketserver
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+
+def parse_address(address):
+    """ "tcp:host:port" or "unix:path" -> (family, socket address) """
+    kind, _, rest = address.partition(":")
+    if kind == "unix":
+        return socket.AF_UNIX, rest
+    if kind == "tcp":
+        host, _, port = rest.rpartition(":")
+        return socket.AF_INET, (host or "0.0.0.0", int(port))
+    raise ValueError("expected tcp:host:port or unix:path, got " + address)
+
+
+class work_queue:
+    def __init__(self, jobs, output, lease, max_attempts):
+        self.lock = threading.Lock()
+        self.lease = lease
+        self.max_attempts = max_attempts
+        self.output = output
+        self.units = {}   # unit -> (job, seed)
+        self.pending = [] # units not handed out, in order
+        self.leases = {}  # unit -> (deadline, owner)
+        self.results = {} # job -> output lines
+        self.attempts = {} # unit -> times handed out
+        self.failed = []  # units given up after max_attempts
+        done = set()
+        if os.path.exists(output):
+            with open(output) as f:
+                for line in f:
+                    fields = line.split(None, 1)
+                    if len(fields) == 2:
+                        job, result = fields[0], fields[1].strip()
+                        seed = result.split()[-1]
+                        done.add((job, seed))
+                        self.results.setdefault(job, []).append(result)
+        for job, games in jobs:
+            self.results.setdefault(job, [])
+            for seed in range(1, games + 1):
+                unit = len(self.units)
+                self.units[unit] = (job, seed)
+                if (job, str(seed)) not in done:
+                    self.pending.append(unit)
+        self.remaining = len(self.pending)
+        self.file = open(output, "a")
+        self.finished = threading.Event()
+        if self.remaining == 0:
+            self.finished.set()
+
+    def give_back(self, unit):
+        """ queues a unit again, or gives up on it after max_attempts """
+        if self.attempts.get(unit, 0) < self.max_attempts:
+            self.pending.insert(0, unit)
+            return
+        job, seed = self.units[unit]
+        print("Unit %d (%s %d) failed %d times, giving up" % (unit, job, seed, self.max_attempts), file=sys.stderr)
+        self.failed.append(unit)
+        self.remaining -= 1
+        if self.remaining == 0:
+            self.finished.set()
+
+    def expire(self):
+        now = time.time()
+        for unit, (deadline, _) in list(self.leases.items()):
+            if deadline < now:
+                del self.leases[unit]
+                self.give_back(unit)
+
+    def request(self, owner):
+        with self.lock:
+            self.expire()
+            if self.pending:
+                unit = self.pending.pop(0)
+                self.leases[unit] = (time.time() + self.lease, owner)
+                self.attempts[unit] = self.attempts.get(unit, 0) + 1
+                job, seed = self.units[unit]
+                return {"unit": unit, "job": job, "seed": seed, "lease": self.lease}
+            if self.remaining == 0:
+                return {"done": True}
+            # everything is leased, a unit may still come back
+            return {"wait": min(self.lease, 5)}
+
+    def renew(self, unit, owner):
+        with self.lock:
+            if unit in self.leases:
+                self.leases[unit] = (time.time() + self.lease, owner)
+            return {"ok": True}
+
+    def result(self, unit, output):
+        with self.lock:
+            if unit not in self.leases and unit not in self.pending:
+                return {"ok": True} # already done by another worker
+            self.leases.pop(unit, None)
+            if unit in self.pending:
+                self.pending.remove(unit)
+            job, _ = self.units[unit]
+            line = output.strip()
+            self.file.write("%s %s\n" % (job, line))
+            self.file.flush()
+            self.results[job].append(line)
+            self.remaining -= 1
+            if self.remaining == 0:
+                self.finished.set()
+            return {"ok": True}
+
+    def fail(self, unit, error):
+        with self.lock:
+            if unit in self.leases:
+                del self.leases[unit]
+                job, seed = self.units[unit]
+                print("Unit %d (%s %d): %s" % (unit, job, seed, error), file=sys.stderr)
+                self.give_back(unit)
+            return {"ok": True}
+
+    def release(self, owner):
+        """ hands out the units of a lost worker again """
+        with self.lock:
+            for unit, (_, o) in list(self.leases.items()):
+                if o == owner:
+                    del self.leases[unit]
+                    self.give_back(unit)
+
+    def report(self):
+        """ prints the failed units, true if there are none """
+        for unit in self.failed:
+            job, seed = self.units[unit]
+            print("Failed: %s seed %d" % (job, seed), file=sys.stderr)
+        return not self.failed
+
+    def merge(self, directory):
+        if not os.path.isdir(directory):
+            os.makedirs(directory)
+        for job, lines in self.results.items():
+            with open(os.path.join(directory, "res_%s.txt" % job), "w") as f:
+                for line in lines:
+                    f.write(line + "\n")
+
+
+class handler(socketserver.StreamRequestHandler):
+    def handle(self):
+        queue = self.server.queue
+        owner = object()
+        try:
+            for line in self.rfile:
+                message = json.loads(line.decode())
+                op = message.get("op")
+                if op == "request":
+                    reply = queue.request(owner)
+                elif op == "renew":
+                    reply = queue.renew(message["unit"], owner)
+                elif op == "result":
+                    reply = queue.result(message["unit"], message["output"])
+                elif op == "fail":
+                    reply = queue.fail(message["unit"], message.get("error", ""))
+                else:
+                    reply = {"error": "unknown op"}
+                self.wfile.write((json.dumps(reply) + "\n").encode())
+                self.wfile.flush()
+        except (ConnectionError, ValueError):
+            pass
+        finally:
+            queue.release(owner)
+
+
+class tcp_server(socketserver.ThreadingMixIn, socketserver.TCPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+
+class unix_server(socketserver.ThreadingMixIn, socketserver.UnixStreamServer):
+    daemon_threads = True
+
+
+def start_server(address, queue):
+    family, addr = parse_address(address)
+    if family == socket.AF_UNIX:
+        if os.path.exists(addr):
+            os.remove(addr)
+        server = unix_server(addr, handler)
+    else:
+        server = tcp_server(addr, handler)
+    server.queue = queue
+    thread = threading.Thread(target=server.serve_forever)
+    thread.daemon = True
+    thread.start()
+    return server
+
+
+def serve(args):
+    queue = work_queue(args.job, args.output, args.lease, args.max_attempts)
+    server = start_server(args.listen, queue)
+    print("Serving %d units on %s" % (queue.remaining, args.listen))
+    queue.finished.wait()
+    queue.merge(os.path.join(args.engine_dir, "data"))
+    # let the workers see "done" before going away
+    time.sleep(1)
+    server.shutdown()
+    print("Finished")
+    return queue.report()
+
+
+class connection:
+    def __init__(self, address):
+        family, addr = parse_address(address)
+        self.socket = socket.socket(family, socket.SOCK_STREAM)
+        self.socket.connect(addr)
+        self.file = self.socket.makefile("rwb")
+        self.lock = threading.Lock()
+
+    def call(self, message):
+        with self.lock:
+            self.file.write((json.dumps(message) + "\n").encode())
+            self.file.flush()
+            line = self.file.readline()
+            if not line:
+                raise ConnectionError("coordinator went away")
+            return json.loads(line.decode())
+
+
+def run_unit(conn, unit, engine_dir):
+    """ runs one game, renewing the lease until it is over """
+    command = [os.path.join(engine_dir, "mmcts_" + unit["job"]), str(unit["seed"])]
+    book = os.path.join(engine_dir, "data", "book_%s.bin" % unit["job"])
+    if os.path.exists(book):
+        command.append(book)
+    try:
+        process = subprocess.Popen(command, stdout=subprocess.PIPE, universal_newlines=True)
+    except OSError as e:
+        # a missing or broken engine, not a lost coordinator
+        print("Unit %d (%s %d): cannot run %s: %s" % (unit["unit"], unit["job"], unit["seed"], command[0], e), file=sys.stderr)
+        conn.call({"op": "fail", "unit": unit["unit"], "error": "cannot run %s: %s" % (command[0], e)})
+        return
+    while True:
+        try:
+            output, _ = process.communicate(timeout=unit["lease"] / 3.0)
+            break
+        except subprocess.TimeoutExpired:
+            conn.call({"op": "renew", "unit": unit["unit"]})
+    if process.returncode != 0 or not output.strip():
+        print("Unit %d (%s %d) failed" % (unit["unit"], unit["job"], unit["seed"]), file=sys.stderr)
+        conn.call({"op": "fail", "unit": unit["unit"], "error": "engine exited with %d" % process.returncode})
+        return
+    conn.call({"op": "result", "unit": unit["unit"], "output": output})
+
+
+def work_slot(address, engine_dir):
+    try:
+        conn = connection(address)
+        while True:
+            if not work_step(conn, engine_dir):
+                return
+    except (ConnectionError, OSError):
+        print("Lost the coordinator", file=sys.stderr)
+
+
+def work_step(conn, engine_dir):
+    """ asks for and runs one unit, false when there is no more work """
+    reply = conn.call({"op": "request"})
+    if reply.get("done"):
+        return False
+    if "wait" in reply:
+        time.sleep(reply["wait"])
+    else:
+        run_unit(conn, reply, engine_dir)
+    return True
+
+
+def work(args):
+    threads = [threading.Thread(target=work_slot, args=(args.connect, args.engine_dir)) for _ in range(args.slots)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+
+def local(args):
+    address = "unix:" + os.path.join(tempfile.mkdtemp(), "coordinator.sock")
+    queue = work_queue(args.job, args.output, args.lease, args.max_attempts)
+    server = start_server(address, queue)
+    workers = [subprocess.Popen([sys.executable, os.path.abspath(__file__), "work", "--connect", address,
+                                 "--engine-dir", args.engine_dir]) for _ in range(args.workers)]
+    queue.finished.wait()
+    queue.merge(os.path.join(args.engine_dir, "data"))
+    for w in workers:
+        w.wait()
+    server.shutdown()
+    os.remove(parse_address(address)[1])
+    print("Finished")
+    return queue.report()
+
+
+def job_spec(text):
+    job, _, games = text.rpartition(":")
+    return job, int(games)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Coordinator and workers for mmcts table runs")
+    sub = parser.add_subparsers(dest="mode")
+    for mode in ["serve", "local"]:
+        p = sub.add_parser(mode)
+        p.add_argument("--job", type=job_spec, action="append", required=True, help="<job>:<games>, repeatable")
+        p.add_argument("--output", default="results.txt")
+        p.add_argument("--lease", type=float, default=60.0, help="seconds a unit stays leased without renewal")
+        p.add_argument("--max-attempts", type=int, default=3, help="times a unit is handed out before it counts as failed")
+        p.add_argument("--engine-dir", default=".")
+        if mode == "serve":
+            p.add_argument("--listen", required=True, help="tcp:host:port or unix:path")
+        else:
+            p.add_argument("--workers", type=int, default=os.cpu_count())
+    p = sub.add_parser("work")
+    p.add_argument("--connect", required=True, help="tcp:host:port or unix:path")
+    p.add_argument("--slots", type=int, default=1, help="games to run at once")
+    p.add_argument("--engine-dir", default=".")
+    args = parser.parse_args()
+    if args.mode == "serve":
+        return 0 if serve(args) else 1
+    if args.mode == "work":
+        work(args)
+        return 0
+    if args.mode == "local":
+        return 0 if local(args) else 1
+    parser.print_help()
+    return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
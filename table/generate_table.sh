@@ -3,7 +3,7 @@
 mkdir -p data
 
 # initialize the job pool
-thread_count=4;
+thread_count=$(nproc);
 if [ $# -eq 1 ]; then
 	thread_count=$1 
 fi
@@ -16,30 +16,108 @@ cp=1
 dims=(8 10 12)
 lens=(6 7 8)
 deps=(100000 100000 100000)
+# maximum number of tree nodes per game (0 = unlimited), bounds the memory of a game
+nb=20000
+# plies of the opening book built per configuration (0 = none), the moves followed
+# from each book position and the dives per book position as a multiple of board_d
+book_plies=0
+book_width=3
+book_factor=10
 
+# games are played in batches; after every batch a configuration stops once its
+# winner is significant (see aggregate.py), at most looks batches in total
+batch=20
+looks=10
+alpha=0.05
+
+# pools the batch results of a configuration into data/res_<job>.txt and
+# removes its binary and batch files
+merge() {
+	local files=(data/res_$1_*.txt)
+	[ -e "${files[0]}" ] || files=()
+	cat /dev/null "${files[@]}" > data/res_$1.txt
+	rm -f mmcts_$1 "${files[@]}"
+}
+
+active=()
+# configurations stopped without a significant winner, and those that never
+# reached a decision (failed or empty batches)
+undecided_jobs=()
+incomplete_jobs=()
 for a in ${!dims[@]}; do
 	w=${dims[$a]}
 	m=${lens[$a]}
 	d=${deps[$a]}
 	jobstr="${cp}_${p}_${w}_${m}_${d}"
+	if [ $nb -ne 0 ]; then
+		jobstr="${jobstr}_n${nb}"
+	fi
+	if [ $book_plies -ne 0 ]; then
+		jobstr="${jobstr}_b${book_plies}"
+	fi
 	if [ -s "data/res_${jobstr}.txt" ]
 	then
 		echo "Skipping job ${jobstr}"
 	else
-		g++ -std=c++17 mmcts.cc -o "mmcts_${jobstr}" -Dboard_w=${w} -Dboard_m=${m} -Dboard_d=${d} -DCAN_PASS=${cp} -DPASS_PLAYER=${p}
-		for j in {1..100}; do
+		g++ -std=c++17 mmcts.cc -o "mmcts_${jobstr}" -Dboard_w=${w} -Dboard_m=${m} -Dboard_d=${d} -DCAN_PASS=${cp} -DPASS_PLAYER=${p} -Dnode_budget=${nb}
+		if [ $book_plies -ne 0 ] && [ ! -s "data/book_${jobstr}.bin" ]; then
+			./mmcts_${jobstr} book "data/book_${jobstr}.bin" ${book_plies} ${book_width} $((book_factor*d))
+		fi
+		active+=("${jobstr}")
+	fi
+done
+
+for ((look = 1; look <= looks && ${#active[@]} > 0; look++)); do
+	# the next batch of every undecided configuration shares the pool
+	for jobstr in "${active[@]}"; do
+		for ((j = (look-1)*batch+1; j <= look*batch; j++)); do
 			job_pool_run ./job.sh "${jobstr}" $j
 		done
-		# sync
-		job_pool_wait
-		# merge
-		cat data/res_${jobstr}_*.txt > data/res_${jobstr}.txt
-		rm mmcts_${jobstr}
-		rm data/res_${jobstr}_*.txt
-		echo "Job ${jobstr} done!"
-	fi
+	done
+	# sync
+	job_pool_wait
+	undecided=()
+	for jobstr in "${active[@]}"; do
+		if ! decision=$(python3 aggregate.py --decide --looks ${looks} --alpha ${alpha} --max-games $((looks*batch)) data/res_${jobstr}_*.txt); then
+			decision="aggregate.py failed"
+		fi
+		case "${decision}" in
+		continue)
+			undecided+=("${jobstr}")
+			;;
+		"stop undecided")
+			merge "${jobstr}"
+			undecided_jobs+=("${jobstr}")
+			echo "Job ${jobstr} done after $((look*batch)) games without a significant winner"
+			;;
+		"stop "*)
+			merge "${jobstr}"
+			echo "Job ${jobstr} done after $((look*batch)) games: ${decision}"
+			;;
+		*)
+			# keep the batch results for a rerun
+			echo "Job ${jobstr}: no decision (${decision}), stopping" >&2
+			job_pool_shutdown
+			exit 1
+			;;
+		esac
+	done
+	active=("${undecided[@]}")
+done
+
+# every look is used up, but some batches failed or came back empty
+for jobstr in "${active[@]}"; do
+	merge "${jobstr}"
+	incomplete_jobs+=("${jobstr}")
 done
 
 # don't forget to shut down the job pool
 job_pool_shutdown
+if [ ${#undecided_jobs[@]} -gt 0 ]; then
+	echo "Undecided: ${undecided_jobs[*]}"
+fi
+if [ ${#incomplete_jobs[@]} -gt 0 ]; then
+	echo "Incomplete, results merged as far as they go: ${incomplete_jobs[*]}" >&2
+	exit 1
+fi
 echo "Finished"
\ No newline at end of file
@@ -2,5 +2,9 @@
 
 if [ ! -s "data/res_$1_$2.txt" ]
 then
-	./mmcts_$1 $RANDOM > data/res_$1_$2.txt
+	if [ -s "data/book_$1.bin" ]; then
+		./mmcts_$1 $RANDOM "data/book_$1.bin" > data/res_$1_$2.txt
+	else
+		./mmcts_$1 $RANDOM > data/res_$1_$2.txt
+	fi
 fi
\ No newline at end of file
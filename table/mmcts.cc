@@ -2,6 +2,19 @@
 #include <string>
 #include <vector>
 #include <cmath>
+#include <chrono>
+#include <sstream>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <unordered_map>
+#include <random>
+#include <new>
+#include "ovc.h"
+#include "../perf_counters.h"
+#include "../game_record.h"
 #define NDEBUG
 #include <cassert>
 
@@ -15,13 +28,74 @@
 //#define board_m 5
 //#define board_w 6
 //#define board_d 5000
+// Optional: maximum number of tree nodes, 0 for no limit
+//#define node_budget 20000
+
+// Optional: choose a move as a cell first and then a symbol, see DECOMPOSED below
+//#define DECOMPOSED 1
+// Optional: the playout policy, one of random_move, block_move, extend_move
+//#define PLAYOUT_POLICY block_move
+// Optional: blend all-moves-as-first statistics into selection, see RAVE below
+//#define RAVE 1
+//#define rave_k 1000
+// Optional: solve positions with at most this many empty cells exactly, see endgame_solver
+//#define endgame_empty 10
+
+#ifndef node_budget
+#define node_budget 0
+#endif
+#ifndef DECOMPOSED
+#define DECOMPOSED 0
+#endif
+#ifndef PLAYOUT_POLICY
+#define PLAYOUT_POLICY random_move
+#endif
+#ifndef RAVE
+#define RAVE 0
+#endif
+#ifndef rave_k
+#define rave_k 1000
+#endif
+#ifndef endgame_empty
+#define endgame_empty 0
+#endif
 
 #define board_h board_w
 #define board_s (board_w*board_h)
 #define board_moves (2*board_s+1)
 #define board_pass (2*board_s)
 
+// With DECOMPOSED a position node has a child per cell (and one for passing at
+// index board_s), and such a cell node has a child per symbol (only child 0 for
+// a pass). The cell statistics are shared by both symbols, so far fewer dives
+// are needed before selection is informed. Cell nodes keep their statistics from
+// the same side as the positions below them.
+#if DECOMPOSED
+#define node_width (board_s+1)
+#else
+#define node_width board_moves
+#endif
+#define pass_child (node_width-1)
+
+// Pruning never removes the children of the root, so the budget must leave room
+// for them and a few levels below.
+#if node_budget
+static_assert( node_budget >= 2*board_moves, "node_budget must be at least twice the number of moves" );
+#endif
+
+// With RAVE every node also counts the dives in which its move was played later
+// by the same player, in the tree or in the playout (all moves as first). A stone
+// is worth about the same whenever it is placed, so these statistics are good
+// long before the node's own; selection weighs them by sqrt(K/(3n+K)) for a node
+// of n visits and K = rave_k.
+#if RAVE and DECOMPOSED
+#error "RAVE needs whole moves, it cannot be combined with DECOMPOSED"
+#endif
+
 typedef std::pair<int,int> win_rate;
+// every search draws from its own generator, so searches are independent and
+// reproducible from their seed
+typedef std::mt19937 prng;
 
 class board {
 	int sq[board_s];
@@ -32,34 +106,116 @@ public:
 	bool is_ordered() const;
 	bool is_disordered() const;
 	int game_over_state() const;
+	int empty_cells() const;
 	inline bool can_move( int r, int c ) const;
 	board& do_move( int r, int c, bool s );
 	bool operator==( const board& ) const;
 };
 
+// Exact minimax for the end of the game. Once a dive reaches a position with at
+// most endgame_empty empty cells, the winner under perfect play is computed here
+// instead of playing out, and stored in the node as proven. Positions are
+// memoized by their O and X cells and the player to move, so the later dives
+// into the same endgame cost a lookup.
+class endgame_solver {
+	struct key {
+		uint64_t o, x;
+		bool turn;
+		bool operator==( const key& other ) const { return o == other.o and x == other.x and turn == other.turn; }
+	};
+	struct key_hash {
+		size_t operator()( const key& k ) const { return std::hash<uint64_t>()( k.o * 0x9e3779b97f4a7c15ull ^ k.x ^ k.turn ); }
+	};
+	std::unordered_map<key,int8_t,key_hash> memo;
+	// the memo starts over when it grows past this many positions
+	static constexpr size_t max_positions = 1 << 22;
+public:
+	int solve( const board& b, bool turn );
+	size_t size() const { return memo.size(); }
+};
+#if endgame_empty
+static_assert( board_s <= 64, "the endgame memo keys a position by 64 bit masks" );
+#endif
+
+board random_move( board b, bool turn, prng& rng );
+class opening_book;
+board block_move( board b, bool turn, prng& rng );
+board extend_move( board b, bool turn, prng& rng );
+
 class monte_carlo_tree_search {
 public:
+	class node_pool;
 	struct node {
 		win_rate rate;
-		node* children[board_moves];
+#if RAVE
+		win_rate amaf;
+#endif
+		// 1 if the player to move here wins with perfect play, -1 if they lose, 0 if unknown
+		int8_t proven;
+		node* children[node_width];
 	public:
 		node*& get_child( int r, int c, bool symbol );
-		node* get_unexplored_child( board&, bool player );
+		node* get_unexplored_child( board&, bool player, node_pool&, prng& );
 		template<double (*score_function)( win_rate, win_rate )>
 		node* get_best_explored_child( board&, bool player );
+		node* get_unexplored_cell( board&, bool player, node_pool&, prng& );
+		node* get_unexplored_symbol( board&, int cell, node_pool&, prng& );
+		template<double (*score_function)( win_rate, win_rate )>
+		node* get_best_cell( board&, bool player );
+		template<double (*score_function)( win_rate, win_rate )>
+		node* get_best_symbol( board&, int cell );
+		int cell_of( const node* child ) const;
 		node& operator=( const node& ); // here to satisfy the g++ warnings
 		node( const node& ); // here to satisfy the g++ warnings
 		node();
-		~node();
+		void collapse( int max_visits, node_pool& );
+	};
+	// The nodes of one tree. Freed nodes are kept for reuse instead of going back
+	// to the heap, and live_nodes counts those in use against node_budget.
+	class node_pool {
+		std::vector<node*> free_nodes;
+	public:
+		int live_nodes = 0;
+		node* create();
+		// n and its subtree
+		void destroy( node* n );
+		~node_pool();
 	};
 	typedef std::vector<node*> history;
 private:
+	node_pool pool;
 	node* root;
+	void seed( const std::vector<std::pair<int,win_rate>>& stats );
 public:
+	// positions found in the book are played from it (skip) or have their root
+	// statistics seeded from it before the search
+	const opening_book* book;
+	bool book_skip;
+	// if set, simulate appends every move with its root statistics
+	game_record_writer* record;
+	endgame_solver endgame;
+	prng rng;
+	bool solve_endgame( history& h, const board& c, bool next, bool turn, bool& winner );
 	history select( board& b, bool turn ) const;
 	void back_propagate( const history& h, bool turn, bool winner );
-	bool play_out( board b, bool turn ) const;
+#if RAVE
+	void back_propagate_amaf( const history& h, bool turn, bool winner, const std::vector<int>& playout );
+#endif
+	template<board (*policy)( board, bool, prng& ) = PLAYOUT_POLICY>
+	bool play_out( board b, bool turn, std::vector<int>* moves = nullptr );
+	template<board (*policy)( board, bool, prng& ) = PLAYOUT_POLICY>
+	void dive( const board& b, bool turn );
+	template<board (*policy)( board, bool, prng& ) = PLAYOUT_POLICY>
+	int search( const board& b, bool turn, int dives, double ms = 0 );
+	int best_move() const;
+	int book_move( const std::vector<std::pair<int,win_rate>>& stats );
+	void advance( int move );
+	void prune();
+	const node* get_root() const { return root; }
+	const node* get_move_child( int move ) const;
 	bool simulate( board b, bool turn, int dives, bool print = false );
+	bool save( const std::string& filename, const board& b, bool turn ) const;
+	bool load( const std::string& filename, board& b, bool& turn );
 	void clear();
 	monte_carlo_tree_search();
 	~monte_carlo_tree_search();
@@ -154,6 +310,13 @@ int board::game_over_state() const {
 	return -1;
 }
 
+int board::empty_cells() const {
+	int n = 0;
+	for( int i = 0; i < board_s; ++i )
+		n += sq[i] == 0;
+	return n;
+}
+
 inline bool board::can_move( int r, int c ) const {
 	return at( r, c ) == 0;
 }
@@ -203,11 +366,26 @@ std::ostream& operator<<( std::ostream& os, board b ) {
 	return os;
 }
 
-template<board (*do_move)( board, bool )>
-bool play_game( board b, bool turn, bool print = false ) {
+// The move that turns b into c, as symbol*board_s + cell or board_pass.
+int move_between( const board& b, const board& c ) {
+	for( int i = 0; i < board_s; ++i )
+		if( b.at( i / board_w, i % board_w ) != c.at( i / board_w, i % board_w ) )
+			return ( c.at( i / board_w, i % board_w ) - 1 ) * board_s + i;
+	return board_pass;
+}
+
+// Plays a game to its end, appending the moves to moves if given.
+template<board (*do_move)( board, bool, prng& )>
+bool play_game( board b, bool turn, prng& rng, bool print = false, std::vector<int>* moves = nullptr ) {
 	int result;
 	while( ( result = b.game_over_state() ) == NOPLAYER ) {
-		b = do_move( b, turn );
+		if( moves ) {
+			board c = do_move( b, turn, rng );
+			moves->push_back( move_between( b, c ) );
+			b = c;
+		} else {
+			b = do_move( b, turn, rng );
+		}
 		if( print )
 			std::cout << b;
 		turn = not turn;
@@ -215,7 +393,7 @@ bool play_game( board b, bool turn, bool print = false ) {
 	return result;
 }
 
-board random_move( board b, bool turn ) {
+board random_move( board b, bool turn, prng& rng ) {
 	// compute modulus
 	int move_count = 0;
 	for( int r = 0; r < board_h; ++r )
@@ -226,7 +404,7 @@ board random_move( board b, bool turn ) {
 		move_count++;
 	assert( move_count > 0 );
 	// do move
-	int sample = rand() % move_count;
+	int sample = int( rng() % move_count );
 	int s = sample & 1;
 	int j = sample >> 1;
 	for( int r = 0; r < board_h; ++r )
@@ -239,10 +417,89 @@ board random_move( board b, bool turn ) {
 	return b;
 }
 
+// All lines of board_m cells, as cell indices.
+struct line_table {
+	std::vector<std::vector<int>> lines;
+	line_table() {
+		const int dr[4] = { 0, 1, 1, 1 };
+		const int dc[4] = { 1, 0, 1, -1 };
+		for( int d = 0; d < 4; ++d ) {
+			for( int r = 0; r < board_h; ++r ) {
+				for( int c = 0; c < board_w; ++c ) {
+					int er = r + dr[d]*( board_m-1 ), ec = c + dc[d]*( board_m-1 );
+					if( er < 0 or er >= board_h or ec < 0 or ec >= board_w )
+						continue;
+					std::vector<int> line;
+					for( int i = 0; i < board_m; ++i )
+						line.push_back( ( r + dr[d]*i ) * board_w + c + dc[d]*i );
+					lines.push_back( line );
+				}
+			}
+		}
+	}
+};
+
+const line_table all_lines;
+
+// Looks for the open line (one that holds only one symbol) with the most stones,
+// preferring lines that are one move from completion. On success sets the symbol
+// in it, an empty cell of it and the number of stones.
+bool best_open_line( const board& b, int& symbol, int& cell, int& stones ) {
+	stones = 0;
+	for( const std::vector<int>& line : all_lines.lines ) {
+		int count[3] = { 0, 0, 0 }, empty = -1;
+		for( int i : line ) {
+			int v = b.at( i / board_w, i % board_w );
+			count[v]++;
+			if( v == 0 )
+				empty = i;
+		}
+		if( count[0] == 0 or ( count[1] and count[2] ) )
+			continue;
+		int k = count[1] + count[2];
+		if( k > stones ) {
+			stones = k;
+			symbol = count[2] > 0;
+			cell = empty;
+			if( k == board_m-1 )
+				return true;
+		}
+	}
+	return stones > 0;
+}
+
+// ORDER completes a line that is one move from completion, CHAOS breaks it;
+// otherwise a random move.
+board block_move( board b, bool turn, prng& rng ) {
+	int symbol, cell, stones;
+	if( best_open_line( b, symbol, cell, stones ) and stones == board_m-1 )
+		return b.do_move( cell / board_w, cell % board_w, turn == ORDER ? symbol : !symbol );
+	return random_move( b, turn, rng );
+}
+
+// As block_move, but also ORDER extends and CHAOS breaks the open line with the
+// most stones once it is at least half full.
+board extend_move( board b, bool turn, prng& rng ) {
+	int symbol, cell, stones;
+	if( best_open_line( b, symbol, cell, stones ) and 2*stones >= board_m )
+		return b.do_move( cell / board_w, cell % board_w, turn == ORDER ? symbol : !symbol );
+	return random_move( b, turn, rng );
+}
+
 constexpr double confidence_score_function( win_rate child, win_rate parent ) {
 	return double( child.first - child.second ) / double( child.first ) + sqrt( 2.0 * log( double( parent.first ) ) / double( child.first ) );
 }
 
+// Selection score of a child with its own and its all-moves-as-first statistics.
+double rave_score_function( win_rate child, win_rate amaf, win_rate parent ) {
+	double q = double( child.first - child.second ) / double( child.first );
+	if( amaf.first ) {
+		double beta = sqrt( rave_k / ( 3.0 * child.first + rave_k ) );
+		q = ( 1 - beta ) * q + beta * double( amaf.first - amaf.second ) / double( amaf.first );
+	}
+	return q + sqrt( 2.0 * log( double( parent.first ) ) / double( child.first ) );
+}
+
 constexpr double best_score_function( win_rate child, win_rate parent ) {
 	return double( child.first - child.second ) / double( child.first );
 }
@@ -251,7 +508,8 @@ monte_carlo_tree_search::node& monte_carlo_tree_search::node::operator=( const n
 	// If you ever call this function you have a problem
 	assert( false );
 	rate = other.rate;
-	for( int i = 0; i < board_moves; ++i )
+	proven = other.proven;
+	for( int i = 0; i < node_width; ++i )
 		children[i] = other.children[i];
 	return *this;
 }
@@ -262,23 +520,65 @@ monte_carlo_tree_search::node::node( const node& other ) {
 
 monte_carlo_tree_search::node::node() {
 	rate.first = rate.second = 0;
-	for( int i = 0; i < board_moves; ++i )
+#if RAVE
+	amaf.first = amaf.second = 0;
+#endif
+	proven = 0;
+	for( int i = 0; i < node_width; ++i )
 		children[i] = nullptr;
 }
 
-monte_carlo_tree_search::node::~node() {
-	for( int i = 0; i < board_moves; ++i )
-		if( children[i] )
-			delete children[i];
+monte_carlo_tree_search::node* monte_carlo_tree_search::node_pool::create() {
+	live_nodes++;
+	if( free_nodes.empty() )
+		return new node();
+	node* n = free_nodes.back();
+	free_nodes.pop_back();
+	return new( n ) node();
+}
+
+void monte_carlo_tree_search::node_pool::destroy( node* n ) {
+	for( int i = 0; i < node_width; ++i )
+		if( n->children[i] )
+			destroy( n->children[i] );
+	live_nodes--;
+	free_nodes.push_back( n );
+}
+
+monte_carlo_tree_search::node_pool::~node_pool() {
+	for( node* n : free_nodes )
+		delete n;
+}
+
+// Deletes the subtrees below every descendant visited at most max_visits times.
+// Such a descendant keeps its own statistics, which already summarize the
+// subtree, and is expanded again if the search returns to it.
+void monte_carlo_tree_search::node::collapse( int max_visits, node_pool& pool ) {
+	for( int i = 0; i < node_width; ++i ) {
+		node* n = children[i];
+		if( n == nullptr )
+			continue;
+		if( n->rate.first <= max_visits ) {
+			for( int j = 0; j < node_width; ++j ) {
+				if( n->children[j] ) {
+					pool.destroy( n->children[j] );
+					n->children[j] = nullptr;
+				}
+			}
+		} else {
+			n->collapse( max_visits, pool );
+		}
+	}
 }
 
 monte_carlo_tree_search::node*& monte_carlo_tree_search::node::get_child( int r, int c, bool symbol ) {
+	assert( not DECOMPOSED );
 	return children[symbol*board_s+r*board_w+c];
 }
 
-monte_carlo_tree_search::node* monte_carlo_tree_search::node::get_unexplored_child( board& b, bool turn ) {
+monte_carlo_tree_search::node* monte_carlo_tree_search::node::get_unexplored_child( board& b, bool turn, node_pool& pool, prng& rng ) {
 	int movec = 0;
-	if( CAN_PASS and turn == PASS_PLAYER and children[board_pass] == nullptr )
+	if( CAN_PASS and turn == PASS_PLAYER and children[pass_child] == nullptr )
 		movec++;
 	for( int r = 0; r < board_h; ++r )
 		for( int c = 0; c < board_w; ++c )
@@ -288,17 +588,31 @@ monte_carlo_tree_search::node* monte_carlo_tree_search::node::get_unexplored_chi
 						movec++;
 	if( movec == 0 )
 		return nullptr;
-	int choice = rand() % movec;
+	int choice = int( rng() % movec );
 	for( int r = 0; r < board_h; ++r )
 		for( int c = 0; c < board_w; ++c )
 			if( b.can_move( r, c ) )
 				for( int s = 0; s < 2; ++s )
 					if( ( get_child( r, c, s ) == nullptr ) and ( (choice--) == 0 ) ) {
 						b.do_move( r, c, s );
-						return get_child( r, c, s ) = new node;
+						return get_child( r, c, s ) = pool.create();
 					}
-	assert( choice == 0 and children[board_pass] == nullptr );
-	return children[board_pass] = new node;
+	assert( choice == 0 and children[pass_child] == nullptr );
+	return children[pass_child] = pool.create();
+}
+
+// The score of a child; with RAVE the confidence score also weighs in the
+// child's all-moves-as-first statistics. A proven win for the player making the
+// move beats any score and a proven loss is below all of them.
+template<double (*score_function)( win_rate, win_rate )>
+inline double child_score( const monte_carlo_tree_search::node* child, win_rate parent ) {
+	if( child->proven )
+		return child->proven < 0 ? 2.0 : -0.25;
+#if RAVE
+	if( score_function == confidence_score_function )
+		return rave_score_function( child->rate, child->amaf, parent );
+#endif
+	return score_function( child->rate, parent );
 }
 
 template<double (*score_function)( win_rate, win_rate )>
@@ -312,7 +626,7 @@ monte_carlo_tree_search::node* monte_carlo_tree_search::node::get_best_explored_
 				for( int s = 0; s < 2; ++s ) {
 					if( get_child( r, c, s ) == nullptr )
 						return nullptr;
-					double score = score_function( get_child( r, c, s )->rate, rate );
+					double score = child_score<score_function>( get_child( r, c, s ), rate );
 					if( score > bscore ) {
 						bscore = score;
 						br = r;
@@ -324,10 +638,10 @@ monte_carlo_tree_search::node* monte_carlo_tree_search::node::get_best_explored_
 		}
 	}
 	if( CAN_PASS and turn == PASS_PLAYER ) {
-		if( children[board_pass] == nullptr )
+		if( children[pass_child] == nullptr )
 			return nullptr;
-		if( score_function( children[board_pass]->rate, rate ) > bscore )
-			return children[board_pass];
+		if( child_score<score_function>( children[pass_child], rate ) > bscore )
+			return children[pass_child];
 	}		
 	assert( bscore > -0.5 );
 
@@ -335,48 +649,712 @@ monte_carlo_tree_search::node* monte_carlo_tree_search::node::get_best_explored_
 	return get_child( br, bc, bs );
 }
 
+// The index of child among the children, i.e. the cell of a cell node.
+int monte_carlo_tree_search::node::cell_of( const node* child ) const {
+	for( int i = 0; i < node_width; ++i )
+		if( children[i] == child )
+			return i;
+	return -1;
+}
+
+monte_carlo_tree_search::node* monte_carlo_tree_search::node::get_unexplored_cell( board& b, bool turn, node_pool& pool, prng& rng ) {
+	int movec = 0;
+	if( CAN_PASS and turn == PASS_PLAYER and children[board_s] == nullptr )
+		movec++;
+	for( int i = 0; i < board_s; ++i )
+		if( b.can_move( i / board_w, i % board_w ) and children[i] == nullptr )
+			movec++;
+	if( movec == 0 )
+		return nullptr;
+	int choice = int( rng() % movec );
+	for( int i = 0; i < board_s; ++i )
+		if( b.can_move( i / board_w, i % board_w ) and children[i] == nullptr and (choice--) == 0 )
+			return children[i] = pool.create();
+	assert( choice == 0 and children[board_s] == nullptr );
+	return children[board_s] = pool.create();
+}
+
+monte_carlo_tree_search::node* monte_carlo_tree_search::node::get_unexplored_symbol( board& b, int cell, node_pool& pool, prng& rng ) {
+	if( cell == board_s )
+		return children[0] = pool.create();
+	int s = ( children[0] == nullptr and children[1] == nullptr ) ? int( rng() % 2 ) : ( children[0] != nullptr );
+	assert( children[s] == nullptr );
+	b.do_move( cell / board_w, cell % board_w, s );
+	return children[s] = pool.create();
+}
+
+template<double (*score_function)( win_rate, win_rate )>
+monte_carlo_tree_search::node* monte_carlo_tree_search::node::get_best_cell( board& b, bool turn ) {
+	double bscore = -1.0;
+	node* best = nullptr;
+	for( int i = 0; i < board_s; ++i ) {
+		if( b.can_move( i / board_w, i % board_w ) ) {
+			if( children[i] == nullptr )
+				return nullptr;
+			double score = score_function( children[i]->rate, rate );
+			if( score > bscore ) {
+				bscore = score;
+				best = children[i];
+			}
+		}
+	}
+	if( CAN_PASS and turn == PASS_PLAYER ) {
+		if( children[board_s] == nullptr )
+			return nullptr;
+		if( score_function( children[board_s]->rate, rate ) > bscore )
+			return children[board_s];
+	}
+	assert( best != nullptr );
+	return best;
+}
+
+template<double (*score_function)( win_rate, win_rate )>
+monte_carlo_tree_search::node* monte_carlo_tree_search::node::get_best_symbol( board& b, int cell ) {
+	if( cell == board_s )
+		return children[0];
+	if( children[0] == nullptr or children[1] == nullptr )
+		return nullptr;
+	int s = child_score<score_function>( children[1], rate ) > child_score<score_function>( children[0], rate );
+	b.do_move( cell / board_w, cell % board_w, s );
+	return children[s];
+}
+
 monte_carlo_tree_search::history monte_carlo_tree_search::select( board& b, bool turn ) const {
+	PERF_REGION( selection, "selection" );
 	history h = { root };
 	node* current = root;
-	while( ( current != nullptr ) and ( b.game_over_state() == NOPLAYER ) ) {
-		current = current->get_best_explored_child<confidence_score_function>( b, turn );
+	// proven positions below the root need no further search
+	while( ( current != nullptr ) and ( current == root or current->proven == 0 ) and ( b.game_over_state() == NOPLAYER ) ) {
+		if( DECOMPOSED ) {
+			node* cell = current->get_best_cell<confidence_score_function>( b, turn );
+			h.push_back( cell );
+			if( cell == nullptr )
+				break;
+			current = cell->get_best_symbol<confidence_score_function>( b, current->cell_of( cell ) );
+		} else {
+			current = current->get_best_explored_child<confidence_score_function>( b, turn );
+		}
 		turn = !turn;
 		h.push_back( current );
 	}
 	return h;
 }
 
+// Which player the statistics of history entry k are counted for. Without
+// DECOMPOSED that alternates; with it a cell node counts for the same side as the
+// position below it.
+inline bool node_side( size_t k, bool turn ) {
+	return DECOMPOSED ? turn ^ ( ( ( k+1 ) / 2 ) & 1 ) : turn ^ ( k & 1 );
+}
+
 void monte_carlo_tree_search::back_propagate( const history& h, bool turn, bool winner ) {
-	for( node* n : h ) {
-		n->rate.first += 1;
-		n->rate.second += ( turn == winner );
-		turn = !turn;
+	for( size_t k = 0; k < h.size(); ++k ) {
+		h[k]->rate.first += 1;
+		h[k]->rate.second += ( node_side( k, turn ) == winner );
+	}
+}
+
+#if RAVE
+// Counts the dive for every child whose move its player made later in the dive:
+// the moves along h, then the playout moves.
+void monte_carlo_tree_search::back_propagate_amaf( const history& h, bool turn, bool winner, const std::vector<int>& playout ) {
+	std::vector<int> moves;
+	for( size_t k = 0; k+1 < h.size(); ++k )
+		for( int i = 0; i < node_width; ++i )
+			if( h[k]->children[i] == h[k+1] )
+				moves.push_back( i );
+	moves.insert( moves.end(), playout.begin(), playout.end() );
+	for( size_t k = 0; k < h.size(); ++k ) {
+		bool side = node_side( k+1, turn ) == winner;
+		// moves[j] is made from depth j
+		for( size_t j = k; j < moves.size(); j += 2 ) {
+			node* child = h[k]->children[moves[j]];
+			if( child ) {
+				child->amaf.first += 1;
+				child->amaf.second += side;
+			}
+		}
+	}
+}
+#endif
+
+// The winner of b with turn to move under perfect play, memoized per position.
+int endgame_solver::solve( const board& b, bool turn ) {
+	int state = b.game_over_state();
+	if( state != NOPLAYER )
+		return state;
+	key k = { 0, 0, turn };
+	for( int i = 0; i < board_s; ++i ) {
+		int v = b.at( i / board_w, i % board_w );
+		if( v == 1 )
+			k.o |= uint64_t( 1 ) << i;
+		else if( v == 2 )
+			k.x |= uint64_t( 1 ) << i;
+	}
+	auto it = memo.find( k );
+	if( it != memo.end() )
+		return it->second;
+	int winner = !turn;
+	for( int i = 0; i < board_s and winner != turn; ++i ) {
+		if( not b.can_move( i / board_w, i % board_w ) )
+			continue;
+		for( int s = 0; s < 2 and winner != turn; ++s ) {
+			board c = b;
+			if( solve( c.do_move( i / board_w, i % board_w, s ), !turn ) == turn )
+				winner = turn;
+		}
+	}
+	if( winner != turn and CAN_PASS and turn == PASS_PLAYER and solve( b, !turn ) == turn )
+		winner = turn;
+	if( memo.size() >= max_positions )
+		memo.clear();
+	memo[k] = int8_t( winner );
+	return winner;
+}
+
+// Solves the position c after the last move of h, with next to move, if it has
+// at most endgame_empty empty cells. The leaf is marked proven and, without
+// DECOMPOSED, so are the ancestors that follow from it: a position is won when
+// one of its moves leads to a lost position, and lost when all its moves lead to
+// won ones.
+bool monte_carlo_tree_search::solve_endgame( history& h, const board& c, bool next, bool turn, bool& winner ) {
+	if( not endgame_empty or c.empty_cells() > endgame_empty )
+		return false;
+	winner = endgame.solve( c, next );
+	size_t k = h.size()-1;
+	h[k]->proven = node_side( k, turn ) == winner ? 1 : -1;
+	int empty = c.empty_cells();
+	for( ; not DECOMPOSED and k > 0; --k ) {
+		node* parent = h[k-1];
+		if( parent->cell_of( h[k] ) != board_pass )
+			empty++;
+		if( h[k]->proven < 0 ) {
+			parent->proven = 1;
+			continue;
+		}
+		int moves = 2*empty + ( CAN_PASS and node_side( k-1, turn ) == PASS_PLAYER );
+		for( int i = 0; i < node_width; ++i )
+			if( parent->children[i] and parent->children[i]->proven > 0 )
+				moves--;
+		if( moves > 0 )
+			break;
+		parent->proven = -1;
 	}
+	return true;
 }
 
-bool monte_carlo_tree_search::play_out( board b, bool turn ) const {
-	return play_game<random_move>( b, turn );
+template<board (*policy)( board, bool, prng& )>
+bool monte_carlo_tree_search::play_out( board b, bool turn, std::vector<int>* moves ) {
+	PERF_REGION( playout, "playout" );
+	return play_game<policy>( b, turn, rng, false, moves );
+}
+
+template<board (*policy)( board, bool, prng& )>
+void monte_carlo_tree_search::dive( const board& b, bool turn ) {
+	board c = b;
+	history h = select( c, turn );
+	std::vector<int> playout;
+	bool winner = c.is_ordered();
+
+	if( h.back() != nullptr and h.back()->proven ) {
+		winner = node_side( h.size()-1, turn ) ^ ( h.back()->proven < 0 );
+	} else if( h.back() == nullptr and DECOMPOSED ) { // there are unexplored cells or symbols
+		size_t k = h.size()-1;
+		bool cturn = turn ^ ( ( ( k-1 ) / 2 ) & 1 );
+		if( k & 1 ) {
+			h.back() = h[k-1]->get_unexplored_cell( c, cturn, pool, rng );
+			h.push_back( h.back()->get_unexplored_symbol( c, h[k-1]->cell_of( h.back() ), pool, rng ) );
+		} else {
+			h.back() = h[k-1]->get_unexplored_symbol( c, h[k-2]->cell_of( h[k-1] ), pool, rng );
+		}
+		if( not solve_endgame( h, c, !cturn, turn, winner ) )
+			winner = play_out<policy>( c, !cturn );
+	} else if( h.back() == nullptr ) { // there are unexplored children
+		bool cturn = ( turn + h.size() ) % 2;
+		h.back() = h.at( h.size()-2 )->get_unexplored_child( c, cturn, pool, rng );
+		if( not solve_endgame( h, c, !cturn, turn, winner ) )
+			winner = play_out<policy>( c, !cturn, RAVE ? &playout : nullptr );
+	}
+	
+	back_propagate( h, turn, winner );
+#if RAVE
+	back_propagate_amaf( h, turn, winner, playout );
+#endif
+
+	if( node_budget and pool.live_nodes > node_budget )
+		prune();
+}
+
+// Collapses the least visited subtrees until the tree is back to three quarters
+// of the node budget.
+void monte_carlo_tree_search::prune() {
+	for( int max_visits = 1; pool.live_nodes > 3 * ( node_budget / 4 ); max_visits = max_visits > INT_MAX / 2 ? INT_MAX : 2 * max_visits ) {
+		int before = pool.live_nodes;
+		root->collapse( max_visits, pool );
+		// the children of the root stay, so once all of them are within
+		// max_visits no further pass can collapse anything
+		if( pool.live_nodes == before and max_visits >= root->rate.first )
+			break;
+	}
+}
+
+// Runs the given number of dives, or dives until ms milliseconds have passed if
+// ms is positive. Returns the number of dives done.
+template<board (*policy)( board, bool, prng& )>
+int monte_carlo_tree_search::search( const board& b, bool turn, int dives, double ms ) {
+	if( ms <= 0 ) {
+		for( int i = 0; i < dives; ++i )
+			dive<policy>( b, turn );
+		return dives;
+	}
+	auto end = std::chrono::steady_clock::now() + std::chrono::duration<double,std::milli>( ms );
+	int i = 0;
+	do {
+		for( int j = 0; j < 16; ++j, ++i )
+			dive<policy>( b, turn );
+	} while( std::chrono::steady_clock::now() < end );
+	return i;
+}
+
+// The node reached from the root by a move (symbol*board_s + cell, or board_pass),
+// or nullptr if it was not explored.
+const monte_carlo_tree_search::node* monte_carlo_tree_search::get_move_child( int move ) const {
+	if( not DECOMPOSED )
+		return root->children[move];
+	node* cell = root->children[move == board_pass ? board_s : move % board_s];
+	return cell ? cell->children[move == board_pass ? 0 : move / board_s] : nullptr;
+}
+
+// Index of the explored child of n with the best score, or -1.
+int best_child( const monte_carlo_tree_search::node* n, int width ) {
+	int best = -1;
+	double bscore = -1.0;
+	for( int i = 0; i < width; ++i ) {
+		const monte_carlo_tree_search::node* c = n->children[i];
+		if( c == nullptr or c->rate.first == 0 )
+			continue;
+		double score = child_score<best_score_function>( c, n->rate );
+		if( score > bscore ) {
+			bscore = score;
+			best = i;
+		}
+	}
+	return best;
+}
+
+// The explored root move with the best score, encoded as for get_move_child,
+// or -1 if nothing was explored.
+int monte_carlo_tree_search::best_move() const {
+	if( not DECOMPOSED )
+		return best_child( root, board_moves );
+	int cell = best_child( root, board_s+1 );
+	if( cell < 0 )
+		return -1;
+	if( cell == board_s )
+		return board_pass;
+	int s = best_child( root->children[cell], 2 );
+	return s < 0 ? -1 : s*board_s + cell;
+}
+
+// Makes the subtree of the given root move the new root.
+void monte_carlo_tree_search::advance( int move ) {
+	node*& slot = DECOMPOSED ? root->children[move == board_pass ? board_s : move % board_s] : root->children[move];
+	node* child = nullptr;
+	if( DECOMPOSED and slot ) {
+		std::swap( child, slot->children[move == board_pass ? 0 : move / board_s] );
+	} else if( not DECOMPOSED ) {
+		std::swap( child, slot );
+	}
+	pool.destroy( root );
+	root = child ? child : pool.create();
+}
+
+// Checkpoint file: a tree_header, board_s cell bytes (0 empty, 1 O, 2 X) padded
+// to a multiple of 8, then node_count tree_records in preorder. The children of
+// a record follow it directly and next is the index of the record after its
+// subtree, so the file can be walked in place when memory mapped. The AMAF
+// statistics are written as zeros without RAVE, and a tree is only loaded by
+// a build with the same RAVE and endgame_empty settings, as the proven marks
+// depend on the latter.
+struct tree_header {
+	char magic[8];
+	int32_t width, line, can_pass, pass_player, decomposed, rave, endgame, turn;
+	uint32_t node_count, reserved;
+};
+
+struct tree_record {
+	int32_t visits, wins, amaf_visits, amaf_wins;
+	int16_t slot, child_count;
+	uint32_t next;
+	int8_t proven, reserved[3];
+};
+
+static_assert( sizeof( tree_header ) == 48, "tree_header must have no padding" );
+static_assert( sizeof( tree_record ) == 28, "tree_record must have no padding" );
+
+const char tree_magic[8] = { 'O', 'V', 'C', '_', 'M', 'C', 'T', '3' };
+constexpr size_t tree_cells_size = ( board_s + 7 ) / 8 * 8;
+
+void save_node( const monte_carlo_tree_search::node* n, int slot, std::vector<tree_record>& records ) {
+	size_t k = records.size();
+	tree_record r = { n->rate.first, n->rate.second, 0, 0, int16_t( slot ), 0, 0, n->proven, {} };
+#if RAVE
+	r.amaf_visits = n->amaf.first;
+	r.amaf_wins = n->amaf.second;
+#endif
+	records.push_back( r );
+	for( int i = 0; i < node_width; ++i ) {
+		if( n->children[i] ) {
+			records[k].child_count++;
+			save_node( n->children[i], i, records );
+		}
+	}
+	records[k].next = uint32_t( records.size() );
+}
+
+// Rebuilds the subtree at records[k], or returns false if the records are inconsistent.
+bool load_node( monte_carlo_tree_search::node* n, const std::vector<tree_record>& records, uint32_t k, monte_carlo_tree_search::node_pool& pool ) {
+	const tree_record& r = records[k];
+	if( r.next <= k or r.next > records.size() or r.child_count > node_width or r.proven < -1 or r.proven > 1 )
+		return false;
+	n->rate = win_rate( r.visits, r.wins );
+	n->proven = r.proven;
+#if RAVE
+	n->amaf = win_rate( r.amaf_visits, r.amaf_wins );
+#endif
+	uint32_t c = k+1;
+	for( int i = 0; i < r.child_count; ++i ) {
+		if( c >= r.next or records[c].slot < 0 or records[c].slot >= node_width or n->children[records[c].slot] )
+			return false;
+		n->children[records[c].slot] = pool.create();
+		if( not load_node( n->children[records[c].slot], records, c, pool ) )
+			return false;
+		c = records[c].next;
+	}
+	return c == r.next;
+}
+
+// Writes the tree with its root position and player to move.
+bool monte_carlo_tree_search::save( const std::string& filename, const board& b, bool turn ) const {
+	std::vector<tree_record> records;
+	save_node( root, -1, records );
+	tree_header h;
+	memcpy( h.magic, tree_magic, 8 );
+	h.width = board_w;
+	h.line = board_m;
+	h.can_pass = CAN_PASS;
+	h.pass_player = PASS_PLAYER;
+	h.decomposed = DECOMPOSED;
+	h.rave = RAVE;
+	h.endgame = endgame_empty;
+	h.turn = turn;
+	h.node_count = uint32_t( records.size() );
+	h.reserved = 0;
+	char cells[tree_cells_size] = {};
+	for( int i = 0; i < board_s; ++i )
+		cells[i] = char( b.at( i / board_w, i % board_w ) );
+	std::ofstream file( filename, std::ios::binary );
+	file.write( reinterpret_cast<const char*>( &h ), sizeof( h ) );
+	file.write( cells, tree_cells_size );
+	file.write( reinterpret_cast<const char*>( records.data() ), records.size() * sizeof( tree_record ) );
+	return bool( file );
+}
+
+// Replaces the tree, position and player to move by those of a checkpoint made
+// with the same board size and rules. On failure the tree is left unchanged.
+bool monte_carlo_tree_search::load( const std::string& filename, board& b, bool& turn ) {
+	std::ifstream file( filename, std::ios::binary );
+	tree_header h;
+	char cells[tree_cells_size];
+	if( not file.read( reinterpret_cast<char*>( &h ), sizeof( h ) ) or not file.read( cells, tree_cells_size ) )
+		return false;
+	if( memcmp( h.magic, tree_magic, 8 ) or h.width != board_w or h.line != board_m or h.can_pass != CAN_PASS
+			or h.pass_player != PASS_PLAYER or h.decomposed != DECOMPOSED or h.rave != RAVE
+			or h.endgame != endgame_empty or h.node_count == 0 )
+		return false;
+	std::vector<tree_record> records( h.node_count );
+	if( not file.read( reinterpret_cast<char*>( records.data() ), records.size() * sizeof( tree_record ) ) )
+		return false;
+	board c;
+	for( int i = 0; i < board_s; ++i ) {
+		if( cells[i] < 0 or cells[i] > 2 )
+			return false;
+		if( cells[i] )
+			c.do_move( i / board_w, i % board_w, cells[i] == 2 );
+	}
+	node* n = pool.create();
+	if( records[0].next != h.node_count or not load_node( n, records, 0, pool ) ) {
+		pool.destroy( n );
+		return false;
+	}
+	pool.destroy( root );
+	root = n;
+	b = c;
+	turn = h.turn == ORDER;
+	if( node_budget and pool.live_nodes > node_budget )
+		prune();
+	return true;
+}
+
+// Root statistics of the positions of the first plies, searched deeply once per
+// configuration. Positions are stored in canonical form over the 8 symmetries
+// of the board times swapping O and X, which also maps the moves. On disk: a
+// header (magic, board size and rules, plies, position count), then per position
+// its cells at 2 bits each, the player to move, the number of moves and the
+// moves as (move, visits, wins), the most visited first.
+class opening_book {
+	struct header {
+		char magic[8];
+		int32_t width, line, can_pass, pass_player, decomposed, plies;
+		uint32_t position_count, reserved;
+	};
+	static constexpr int cell_bytes = ( board_s + 3 ) / 4;
+	struct book_move {
+		uint16_t move;
+		int32_t visits, wins;
+	} __attribute__(( packed ));
+	std::unordered_map<std::string,std::vector<book_move>> positions;
+	int perm[8][board_s], inverse[8][board_s];
+	// the key of b, turn under transform k = 2*symmetry + swap
+	std::string key( const board& b, bool turn, int k ) const {
+		std::string cells( cell_bytes + 1, '\0' );
+		for( int i = 0; i < board_s; ++i ) {
+			int v = b.at( i / board_w, i % board_w );
+			if( v and ( k & 1 ) )
+				v = 3 - v;
+			int j = perm[k >> 1][i];
+			cells[j >> 2] |= char( v << ( 2 * ( j & 3 ) ) );
+		}
+		cells[cell_bytes] = char( turn );
+		return cells;
+	}
+	std::string canonical( const board& b, bool turn, int& transform ) const {
+		std::string best = key( b, turn, 0 );
+		transform = 0;
+		for( int k = 1; k < 16; ++k ) {
+			std::string c = key( b, turn, k );
+			if( c < best ) {
+				best = c;
+				transform = k;
+			}
+		}
+		return best;
+	}
+	int map_move( int move, int k, bool back ) const {
+		if( move == board_pass )
+			return move;
+		int cell = ( back ? inverse : perm )[k >> 1][move % board_s];
+		return ( ( move / board_s ) ^ ( k & 1 ) ) * board_s + cell;
+	}
+	static constexpr char magic[8] = { 'O', 'V', 'C', '_', 'B', 'O', 'O', 'K' };
+public:
+	int plies = 0;
+	opening_book() {
+		// symmetry = 4*transpose + 2*flip rows + flip columns
+		for( int s = 0; s < 8; ++s ) {
+			for( int r = 0; r < board_h; ++r ) {
+				for( int c = 0; c < board_w; ++c ) {
+					int rr = s & 2 ? board_h-1-r : r;
+					int cc = s & 1 ? board_w-1-c : c;
+					perm[s][r*board_w+c] = s & 4 ? cc*board_w+rr : rr*board_w+cc;
+					inverse[s][perm[s][r*board_w+c]] = r*board_w+c;
+				}
+			}
+		}
+	}
+	size_t size() const { return positions.size(); }
+	bool contains( const board& b, bool turn ) const {
+		int k;
+		return positions.count( canonical( b, turn, k ) ) > 0;
+	}
+	// moves as (move, (visits, wins)), most visited first
+	void insert( const board& b, bool turn, const std::vector<std::pair<int,win_rate>>& stats ) {
+		int k;
+		std::vector<book_move>& moves = positions[canonical( b, turn, k )];
+		moves.clear();
+		for( const auto& m : stats )
+			moves.push_back( { uint16_t( map_move( m.first, k, false ) ), m.second.first, m.second.second } );
+	}
+	bool lookup( const board& b, bool turn, std::vector<std::pair<int,win_rate>>& stats ) const {
+		int k;
+		auto it = positions.find( canonical( b, turn, k ) );
+		if( it == positions.end() )
+			return false;
+		stats.clear();
+		for( const book_move& m : it->second )
+			stats.push_back( std::make_pair( map_move( m.move, k, true ), win_rate( m.visits, m.wins ) ) );
+		return true;
+	}
+	bool save( const std::string& filename ) const {
+		header h = {};
+		memcpy( h.magic, magic, 8 );
+		h.width = board_w;
+		h.line = board_m;
+		h.can_pass = CAN_PASS;
+		h.pass_player = PASS_PLAYER;
+		h.decomposed = DECOMPOSED;
+		h.plies = plies;
+		h.position_count = uint32_t( positions.size() );
+		std::ofstream file( filename, std::ios::binary );
+		file.write( reinterpret_cast<const char*>( &h ), sizeof( h ) );
+		for( const auto& p : positions ) {
+			uint16_t n = uint16_t( p.second.size() );
+			file.write( p.first.data(), p.first.size() );
+			file.write( reinterpret_cast<const char*>( &n ), sizeof( n ) );
+			file.write( reinterpret_cast<const char*>( p.second.data() ), n * sizeof( book_move ) );
+		}
+		return bool( file );
+	}
+	bool load( const std::string& filename ) {
+		std::ifstream file( filename, std::ios::binary );
+		header h;
+		if( not file.read( reinterpret_cast<char*>( &h ), sizeof( h ) ) )
+			return false;
+		if( memcmp( h.magic, magic, 8 ) or h.width != board_w or h.line != board_m or h.can_pass != CAN_PASS
+				or h.pass_player != PASS_PLAYER or h.decomposed != DECOMPOSED )
+			return false;
+		positions.clear();
+		plies = h.plies;
+		for( uint32_t i = 0; i < h.position_count; ++i ) {
+			std::string cells( cell_bytes + 1, '\0' );
+			uint16_t n;
+			if( not file.read( &cells[0], cells.size() ) or not file.read( reinterpret_cast<char*>( &n ), sizeof( n ) ) )
+				return false;
+			std::vector<book_move>& moves = positions[cells];
+			moves.resize( n );
+			if( not file.read( reinterpret_cast<char*>( moves.data() ), n * sizeof( book_move ) ) )
+				return false;
+		}
+		return true;
+	}
+};
+
+constexpr char opening_book::magic[8];
+
+// Root statistics of the explored moves, (move, (visits, wins)), most visited first.
+std::vector<std::pair<int,win_rate>> root_stats( const monte_carlo_tree_search& tree ) {
+	std::vector<std::pair<int,win_rate>> stats;
+	for( int i = 0; i < board_moves; ++i ) {
+		const monte_carlo_tree_search::node* n = tree.get_move_child( i );
+		if( n and n->rate.first )
+			stats.push_back( std::make_pair( i, n->rate ) );
+	}
+	std::stable_sort( stats.begin(), stats.end(), []( const std::pair<int,win_rate>& a, const std::pair<int,win_rate>& b ) {
+		return a.second.first > b.second.first;
+	} );
+	return stats;
+}
+
+// Puts the statistics of a book position into the empty root.
+void monte_carlo_tree_search::seed( const std::vector<std::pair<int,win_rate>>& stats ) {
+	for( const auto& m : stats ) {
+		node* n;
+		if( DECOMPOSED ) {
+			node*& cell = root->children[m.first == board_pass ? board_s : m.first % board_s];
+			if( cell == nullptr )
+				cell = pool.create();
+			cell->rate.first += m.second.first;
+			cell->rate.second += m.second.second;
+			n = cell->children[m.first == board_pass ? 0 : m.first / board_s] = pool.create();
+		} else {
+			n = root->children[m.first] = pool.create();
+		}
+		n->rate = m.second;
+		// the root counts the wins of the other side
+		root->rate.first += m.second.first;
+		root->rate.second += m.second.first - m.second.second;
+	}
+}
+
+// The move best_move picks from the given root statistics, so with DECOMPOSED
+// the best cell first and then its best symbol. Clears the tree.
+int monte_carlo_tree_search::book_move( const std::vector<std::pair<int,win_rate>>& stats ) {
+	clear();
+	seed( stats );
+	int move = best_move();
+	assert( move >= 0 );
+	clear();
+	return move;
+}
+
+// Searches the first plies positions of self-play with the given dives and puts
+// them in the book, following the move played from it in skip mode and the
+// next most visited moves, width in all.
+void build_book( opening_book& book, int plies, int width, int dives ) {
+	monte_carlo_tree_search tree;
+	std::vector<std::pair<board,bool>> frontier = { std::make_pair( board(), bool( PASS_PLAYER ) ) };
+	book.plies = plies;
+	for( int ply = 0; ply < plies; ++ply ) {
+		std::vector<std::pair<board,bool>> next;
+		for( const auto& p : frontier ) {
+			if( p.first.game_over_state() != NOPLAYER or book.contains( p.first, p.second ) )
+				continue;
+			tree.clear();
+			tree.search( p.first, p.second, dives );
+			std::vector<std::pair<int,win_rate>> stats = root_stats( tree );
+			book.insert( p.first, p.second, stats );
+			std::vector<int> follow;
+			if( width > 0 and not stats.empty() )
+				follow.push_back( tree.book_move( stats ) );
+			for( int i = 0; int( follow.size() ) < width and i < int( stats.size() ); ++i )
+				if( stats[i].first != follow[0] )
+					follow.push_back( stats[i].first );
+			for( int move : follow ) {
+				board c = p.first;
+				if( move != board_pass )
+					c.do_move( ( move % board_s ) / board_w, move % board_w, move >= board_s );
+				next.push_back( std::make_pair( c, !p.second ) );
+			}
+		}
+		frontier = next;
+		std::cout << "ply " << ply << ": " << book.size() << " positions" << std::endl;
+	}
 }
 
 bool monte_carlo_tree_search::simulate( board b, bool turn, int dives, bool print ) {
 	int result;
+	bool in_book = book != nullptr;
 	while( ( result = b.game_over_state() ) == NOPLAYER ) {
-		for( int i = 0; i < dives; ++i ) {
-			board c = b;
-			history h = select( c, turn );
-			bool winner = c.is_ordered();
-
-			if( h.back() == nullptr ) { // there are unexplored children
-				bool cturn = ( turn + h.size() ) % 2;
-				h.back() = h.at( h.size()-2 )->get_unexplored_child( c, cturn ); 
-				winner = play_out( c, !cturn );
+		std::vector<std::pair<int,win_rate>> stats;
+		in_book = in_book and book->lookup( b, turn, stats ) and not stats.empty();
+		if( in_book and book_skip ) {
+			int move = book_move( stats );
+			if( record ) {
+				uint32_t visits = 0;
+				for( const auto& m : stats )
+					visits += uint32_t( m.second.first );
+				const auto& m = *std::find_if( stats.begin(), stats.end(), [move]( const std::pair<int,win_rate>& s ) { return s.first == move; } );
+				record->add_move( { int16_t( move ), uint8_t( turn ), move_record::from_book, visits, uint32_t( m.second.first ),
+					float( best_score_function( m.second, win_rate() ) ) } );
 			}
-			
-			back_propagate( h, turn, winner );
+			if( move != board_pass )
+				b.do_move( ( move % board_s ) / board_w, move % board_w, move >= board_s );
+			turn = !turn;
+			if( print )
+				std::cout << ( turn ? "\033[32m" : "\033[31m" ) << b << "\033[0m" << "book\n---------" << std::endl;
+			continue;
+		}
+		if( in_book )
+			seed( stats );
+		search( b, turn, dives );
+		const node* choice;
+		int move;
+		if( DECOMPOSED ) {
+			move = best_move();
+			assert( move >= 0 );
+			choice = get_move_child( move );
+			if( move != board_pass )
+				b.do_move( ( move % board_s ) / board_w, move % board_w, move >= board_s );
+		} else {
+			board before = b;
+			choice = root->get_best_explored_child<best_score_function>( b, turn );
+			move = move_between( before, b );
 		}
-		node* choice = root->get_best_explored_child<best_score_function>( b, turn );
-		turn = !turn;
 		assert( choice != nullptr );
+		if( record )
+			record->add_move( { int16_t( move ), uint8_t( turn ), 0, uint32_t( root->rate.first ), uint32_t( choice->rate.first ),
+				float( best_score_function( choice->rate, root->rate ) ) } );
+		turn = !turn;
 
 		if( print ) {
 			std::cout << ( turn ? "\033[32m" : "\033[31m" ) << b << "\033[0m" << choice->rate.second << ":" << choice->rate.first << "\n---------" << std::endl;
@@ -389,26 +1367,372 @@ bool monte_carlo_tree_search::simulate( board b, bool turn, int dives, bool prin
 
 void monte_carlo_tree_search::clear() {
 	if( root )
-		delete root;
-	root = new node();
+		pool.destroy( root );
+	root = pool.create();
 }
 
 monte_carlo_tree_search::monte_carlo_tree_search() {
-	root = new node();
+	root = pool.create();
+	book = nullptr;
+	book_skip = true;
+	record = nullptr;
 }
 
 monte_carlo_tree_search::~monte_carlo_tree_search() {
 	if( root )
-		delete root;
+		pool.destroy( root );
+}
+
+std::string move_name( int move ) {
+	if( move == board_pass )
+		return "pass";
+	std::ostringstream os;
+	int cell = move % board_s;
+	os << ( cell / board_w ) << " " << ( cell % board_w ) << " " << ( move < board_s ? "O" : "X" );
+	return os.str();
+}
+
+// Line protocol on stdin/stdout. Every request is answered with zero or more
+// lines followed by "ok" or "error <reason>".
+//   position <cells> <order|chaos>  set the board, row by row with . O X, and the player to move
+//   move <r> <c> <O|X> | move pass  play a move, keeping the searched subtree
+//   dives <n>                       search n dives
+//   time <ms>                       search for ms milliseconds
+//   stats                           print "root <visits> <wins>" and "child <move> <visits> <wins>"
+//                                   for the explored root moves, wins counted for the player to move
+//   seed <n>                        reseed the PRNG
+//   save <file>                     checkpoint the tree with its position
+//   load <file>                     restore a checkpoint and continue from it
+//   quit
+void serve() {
+	monte_carlo_tree_search tree;
+	board b;
+	bool turn = PASS_PLAYER;
+	std::string line;
+	std::ios::sync_with_stdio( false );
+	while( std::getline( std::cin, line ) ) {
+		std::istringstream is( line );
+		std::string cmd;
+		is >> cmd;
+		if( cmd == "position" ) {
+			std::string cells, player;
+			is >> cells >> player;
+			if( int( cells.size() ) != board_s or cells.find_first_not_of( ".OX" ) != std::string::npos
+					or ( player != "order" and player != "chaos" ) ) {
+				std::cout << "error expected " << board_s << " cells of . O X and order or chaos" << std::endl;
+				continue;
+			}
+			b = board();
+			for( int i = 0; i < board_s; ++i )
+				if( cells[i] == 'O' or cells[i] == 'X' )
+					b.do_move( i / board_w, i % board_w, cells[i] == 'X' );
+			turn = player == "order" ? ORDER : CHAOS;
+			tree.clear();
+		} else if( cmd == "move" ) {
+			std::string a;
+			int r, c;
+			std::string sym;
+			is >> a;
+			if( b.game_over_state() != NOPLAYER ) {
+				std::cout << "error game over" << std::endl;
+				continue;
+			}
+			if( a == "pass" ) {
+				if( not CAN_PASS or turn != PASS_PLAYER ) {
+					std::cout << "error cannot pass" << std::endl;
+					continue;
+				}
+				tree.advance( board_pass );
+			} else {
+				r = atoi( a.c_str() );
+				is >> c >> sym;
+				if( not is or r < 0 or r >= board_h or c < 0 or c >= board_w or not b.can_move( r, c ) or ( sym != "O" and sym != "X" ) ) {
+					std::cout << "error illegal move" << std::endl;
+					continue;
+				}
+				b.do_move( r, c, sym == "X" );
+				tree.advance( ( sym == "X" )*board_s + r*board_w + c );
+			}
+			turn = !turn;
+		} else if( cmd == "dives" or cmd == "time" ) {
+			double amount = 0;
+			is >> amount;
+			if( b.game_over_state() != NOPLAYER ) {
+				std::cout << "error game over" << std::endl;
+				continue;
+			}
+			auto start = std::chrono::steady_clock::now();
+			int n = cmd == "dives" ? tree.search( b, turn, int( amount ) ) : tree.search( b, turn, 0, amount );
+			std::chrono::duration<double,std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			int best = tree.best_move();
+			std::cout << "bestmove " << ( best < 0 ? "none" : move_name( best ) ) << "\n";
+			std::cout << "info dives " << n << " ms " << elapsed.count() << "\n";
+		} else if( cmd == "stats" ) {
+			const monte_carlo_tree_search::node* root = tree.get_root();
+			std::cout << "root " << root->rate.first << " " << root->rate.second << "\n";
+			for( int i = 0; i < board_moves; ++i ) {
+				const monte_carlo_tree_search::node* n = tree.get_move_child( i );
+				const win_rate& rate = n ? n->rate : win_rate( 0, 0 );
+				if( rate.first )
+					std::cout << "child " << move_name( i ) << " " << rate.first << " " << ( rate.first - rate.second ) << "\n";
+			}
+		} else if( cmd == "seed" ) {
+			unsigned seed = 0;
+			is >> seed;
+			tree.rng.seed( seed );
+		} else if( cmd == "save" or cmd == "load" ) {
+			std::string filename;
+			is >> filename;
+			if( filename.empty() ) {
+				std::cout << "error expected a file name" << std::endl;
+				continue;
+			}
+			if( cmd == "save" ? not tree.save( filename, b, turn ) : not tree.load( filename, b, turn ) ) {
+				std::cout << "error cannot " << cmd << " " << filename << std::endl;
+				continue;
+			}
+		} else if( cmd == "quit" ) {
+			std::cout << "ok" << std::endl;
+			return;
+		} else if( not cmd.empty() ) {
+			std::cout << "error unknown command" << std::endl;
+			continue;
+		}
+		std::cout << "ok" << std::endl;
+	}
+}
+
+// Plays games between a search with PLAYOUT_POLICY and one with random_move,
+// both given ms milliseconds per move, switching sides every game.
+void duel( double ms, int games, unsigned seed ) {
+	int played[2] = { 0, 0 }, wins[2] = { 0, 0 };
+	int64_t dives[2] = { 0, 0 }, moves[2] = { 0, 0 };
+	monte_carlo_tree_search tree;
+	tree.rng.seed( seed );
+	for( int g = 0; g < games; ++g ) {
+		bool side = g % 2 ? ORDER : CHAOS; // side of PLAYOUT_POLICY
+		board b;
+		bool turn = PASS_PLAYER;
+		while( b.game_over_state() == NOPLAYER ) {
+			bool p = turn == side;
+			dives[p] += p ? tree.search<PLAYOUT_POLICY>( b, turn, 0, ms ) : tree.search<random_move>( b, turn, 0, ms );
+			moves[p]++;
+			int move = tree.best_move();
+			if( move < 0 ) // the budget did not even expand the root
+				b = random_move( b, turn, tree.rng );
+			else if( move != board_pass )
+				b.do_move( ( move % board_s ) / board_w, move % board_w, move >= board_s );
+			turn = !turn;
+			tree.clear();
+		}
+		played[side]++;
+		wins[side] += b.game_over_state() == side;
+	}
+	std::cout << "policy as ORDER: " << wins[ORDER] << "/" << played[ORDER] << "\n";
+	std::cout << "policy as CHAOS: " << wins[CHAOS] << "/" << played[CHAOS] << "\n";
+	std::cout << "score: " << double( wins[ORDER] + wins[CHAOS] ) / games << "\n";
+	std::cout << "dives per move: policy " << ( moves[1] ? dives[1] / moves[1] : 0 ) << ", random " << ( moves[0] ? dives[0] / moves[0] : 0 ) << std::endl;
+}
+
+struct ovc_search {
+	monte_carlo_tree_search tree;
+	board b;
+	bool turn;
+};
+
+int ovc_board_width() { return board_w; }
+int ovc_line_length() { return board_m; }
+int ovc_can_pass() { return CAN_PASS; }
+int ovc_pass_player() { return PASS_PLAYER; }
+int ovc_move_count() { return board_moves; }
+
+ovc_search* ovc_search_create( unsigned seed ) {
+	ovc_search* s = new ovc_search;
+	s->tree.rng.seed( seed );
+	s->turn = PASS_PLAYER;
+	return s;
+}
+
+void ovc_search_destroy( ovc_search* s ) {
+	delete s;
+}
+
+int ovc_set_position( ovc_search* s, const signed char* cells, int turn ) {
+	board b;
+	for( int i = 0; i < board_s; ++i ) {
+		if( cells[i] < 0 or cells[i] > 2 )
+			return -1;
+		if( cells[i] )
+			b.do_move( i / board_w, i % board_w, cells[i] == 2 );
+	}
+	s->b = b;
+	s->turn = turn == ORDER;
+	s->tree.clear();
+	return 0;
+}
+
+int ovc_play( ovc_search* s, int move ) {
+	if( move < 0 or move >= board_moves or s->b.game_over_state() != NOPLAYER )
+		return -1;
+	if( move == board_pass ) {
+		if( not CAN_PASS or s->turn != PASS_PLAYER )
+			return -1;
+	} else {
+		int cell = move % board_s;
+		if( not s->b.can_move( cell / board_w, cell % board_w ) )
+			return -1;
+		s->b.do_move( cell / board_w, cell % board_w, move >= board_s );
+	}
+	s->tree.advance( move );
+	s->turn = !s->turn;
+	return 0;
 }
 
+int ovc_game_state( const ovc_search* s ) {
+	return s->b.game_over_state();
+}
+
+int ovc_run_dives( ovc_search* s, int dives ) {
+	if( s->b.game_over_state() != NOPLAYER )
+		return 0;
+	return s->tree.search( s->b, s->turn, dives );
+}
+
+int ovc_run_time( ovc_search* s, double ms ) {
+	if( s->b.game_over_state() != NOPLAYER )
+		return 0;
+	return s->tree.search( s->b, s->turn, 0, ms );
+}
+
+int ovc_root_stats( const ovc_search* s, int* visits, int* wins ) {
+	const monte_carlo_tree_search::node* root = s->tree.get_root();
+	for( int i = 0; i < board_moves; ++i ) {
+		const monte_carlo_tree_search::node* n = s->tree.get_move_child( i );
+		const win_rate& rate = n ? n->rate : win_rate( 0, 0 );
+		if( visits )
+			visits[i] = rate.first;
+		if( wins )
+			wins[i] = rate.first - rate.second;
+	}
+	return root->rate.first;
+}
+
+int ovc_best_move( const ovc_search* s ) {
+	return s->tree.best_move();
+}
+
+int ovc_save( const ovc_search* s, const char* filename ) {
+	return s->tree.save( filename, s->b, s->turn ) ? 0 : -1;
+}
+
+int ovc_load( ovc_search* s, const char* filename ) {
+	return s->tree.load( filename, s->b, s->turn ) ? 0 : -1;
+}
+
+int ovc_playouts( ovc_search* s, int n ) {
+	if( s->b.game_over_state() != NOPLAYER )
+		return n * ( s->b.game_over_state() == ORDER );
+	int order_wins = 0;
+	for( int i = 0; i < n; ++i )
+		order_wins += s->tree.play_out( s->b, s->turn );
+	return order_wins;
+}
+
+#ifndef OVC_LIBRARY
 int main( int argc, char* argv[] ) {
 	if( argc <= 1 ) {
 		std::cout << "Error!" << std::endl;
 		return 1;
 	}
-	srand(uint(atoi(argv[1])));
+	if( std::string( argv[1] ) == "serve" ) {
+		serve();
+		return 0;
+	}
+	if( std::string( argv[1] ) == "duel" ) {
+		if( argc <= 4 ) {
+			std::cout << "Usage: duel <ms per move> <games> <seed>" << std::endl;
+			return 1;
+		}
+		duel( atof( argv[2] ), atoi( argv[3] ), uint( atoi( argv[4] ) ) );
+		perf_report( std::cout );
+		return 0;
+	}
+	if( std::string( argv[1] ) == "book" ) {
+		if( argc <= 5 ) {
+			std::cout << "Usage: book <file> <plies> <width> <dives>" << std::endl;
+			return 1;
+		}
+		opening_book book;
+		build_book( book, atoi( argv[3] ), atoi( argv[4] ), atoi( argv[5] ) );
+		return book.save( argv[2] ) ? 0 : 1;
+	}
+	if( std::string( argv[1] ) == "record" ) {
+		// record <file> <games> <first seed> [<book>]: appends the self-play games with their moves
+		if( argc <= 4 ) {
+			std::cout << "Usage: record <file> <games> <first seed> [<book>]" << std::endl;
+			return 1;
+		}
+		opening_book book;
+		if( argc > 5 and not book.load( argv[5] ) ) {
+			std::cout << "Cannot load the book " << argv[5] << std::endl;
+			return 1;
+		}
+		game_record_writer out( argv[2] );
+		if( not out.is_open() ) {
+			std::cout << "Cannot open " << argv[2] << std::endl;
+			return 1;
+		}
+		uint seed = uint( atoi( argv[4] ) );
+		for( int g = 0; g < atoi( argv[3] ); ++g, ++seed ) {
+			monte_carlo_tree_search tree;
+			tree.rng.seed( seed );
+			tree.book = argc > 5 ? &book : nullptr;
+			tree.record = &out;
+			game_header h;
+			h.width = board_w;
+			h.line = board_m;
+			h.can_pass = CAN_PASS;
+			h.pass_player = PASS_PLAYER;
+			h.first_turn = PASS_PLAYER;
+			h.seed = seed;
+			out.begin_game( h );
+			int winner = tree.simulate( board(), PASS_PLAYER, board_d, false );
+			out.end_game( winner );
+			std::cout << winner << " " << seed << std::endl;
+		}
+		return out.flush() ? 0 : 1;
+	}
+	if( std::string( argv[1] ) == "records" ) {
+		// records <file>: one line per recorded game, winner, seed and moves (* from the book)
+		if( argc <= 2 ) {
+			std::cout << "Usage: records <file>" << std::endl;
+			return 1;
+		}
+		game_record_reader in( argv[2] );
+		game_header h;
+		std::vector<move_record> moves;
+		while( in.next( h, moves ) ) {
+			std::cout << int( h.winner ) << " " << h.seed;
+			for( const move_record& m : moves )
+				std::cout << " " << m.move << ( m.flags & move_record::from_book ? "*" : "" );
+			std::cout << std::endl;
+		}
+		return 0;
+	}
 	monte_carlo_tree_search tree;
+	tree.rng.seed( uint( atoi( argv[1] ) ) );
+	// mmcts <seed> [<book> [seed]]: play from the book, or seed the search with it
+	opening_book book;
+	if( argc > 2 ) {
+		if( not book.load( argv[2] ) ) {
+			std::cout << "Cannot load the book " << argv[2] << std::endl;
+			return 1;
+		}
+		tree.book = &book;
+		tree.book_skip = not ( argc > 3 and std::string( argv[3] ) == "seed" );
+	}
 	std::cout << int( tree.simulate( board(), PASS_PLAYER, board_d, false ) ) << " " << argv[1] << std::endl;
+	perf_report( std::cerr );
 	return 0;
-}
\ No newline at end of file
+}
+#endif
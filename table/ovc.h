@@ -0,0 +1,59 @@
+// C interface to the MCTS engine in mmcts.cc, built as a shared library with
+// -DOVC_LIBRARY (see the libovc targets in the top level Makefile). The board
+// size and rules are fixed when the library is compiled and can be queried.
+//
+// Cells are numbered row by row, cell = r*width + c, and hold 0 (empty), 1 (O)
+// or 2 (X). A move is an index in [0, ovc_move_count()): cell for an O,
+// width*width + cell for an X, and 2*width*width for a pass. Players are
+// 0 (CHAOS) and 1 (ORDER). Wins are counted for the player to move at the root.
+#ifndef OVC_H
+#define OVC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ovc_search ovc_search;
+
+int ovc_board_width( void );
+int ovc_line_length( void );
+int ovc_can_pass( void );
+int ovc_pass_player( void );
+int ovc_move_count( void );
+
+// Every search has its own tree and random generator, seeded here, so searches
+// are independent and reproducible. Different searches may be used from
+// different threads, one search only from one thread at a time.
+ovc_search* ovc_search_create( unsigned seed );
+void ovc_search_destroy( ovc_search* s );
+
+// Sets the position and clears the tree. Returns 0, or -1 on invalid cells.
+int ovc_set_position( ovc_search* s, const signed char* cells, int turn );
+// Plays a move, keeping the searched subtree. Returns 0, or -1 if illegal.
+int ovc_play( ovc_search* s, int move );
+// -1 while the game is running, otherwise the winner.
+int ovc_game_state( const ovc_search* s );
+
+// Both return the number of dives done.
+int ovc_run_dives( ovc_search* s, int dives );
+int ovc_run_time( ovc_search* s, double ms );
+
+// Fills visits and wins (ovc_move_count() entries each, may be null) for the
+// root moves and returns the number of root visits.
+int ovc_root_stats( const ovc_search* s, int* visits, int* wins );
+// The best explored root move, or -1.
+int ovc_best_move( const ovc_search* s );
+
+// Checkpoint the tree with its position, or replace both by a checkpoint made
+// by a library with the same board size and rules. Return 0, or -1 on failure.
+int ovc_save( const ovc_search* s, const char* filename );
+int ovc_load( ovc_search* s, const char* filename );
+
+// Plays n random games from the position and returns how many ORDER won.
+int ovc_playouts( ovc_search* s, int n );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
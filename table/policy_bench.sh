@@ -0,0 +1,17 @@
+#!/bin/bash
+# Compares the playout policies against random_move at equal time per move.
+# usage: policy_bench.sh [ms per move] [games]
+
+ms=${1:-100}
+games=${2:-20}
+w=8
+m=6
+cp=1
+p="CHAOS"
+
+for policy in random_move block_move extend_move; do
+	g++ -std=c++17 -O2 mmcts.cc -o "mmcts_bench_${policy}" -Dboard_w=${w} -Dboard_m=${m} -Dboard_d=0 -DCAN_PASS=${cp} -DPASS_PLAYER=${p} -DPLAYOUT_POLICY=${policy}
+	echo "== ${policy} (${w}x${w}, line ${m}, ${ms}ms per move, ${games} games)"
+	./mmcts_bench_${policy} duel ${ms} ${games} 1
+	rm "mmcts_bench_${policy}"
+done
@@ -0,0 +1,60 @@
+#include <fstream>
+#include <iostream>
+#include <bitset>
+#include <vector>
+#include <string>
+#include <utility>
+#include <cstring>
+
+#define NDEBUG
+#include <cassert>
+
+#include "tablebase.h"
+#ifdef EMBEDDED_TABLEBASE
+#include "tablebase_data.h"
+#endif
+
+#define popcount __builtin_popcount
+
+using namespace std;
+
+bitset<_3pow16> order_win, chaos_win;
+
+bool tablebase_correct( const compressed_tablebase& tb ) {
+	for( int32_t i = 0; i < _3pow16; ++i ) {
+		board b = index_to_board( i );
+		if( tb.lookup( b, ORDER ) != order_win.test( i ) or tb.lookup( b, CHAOS ) != chaos_win.test( i ) )
+			return false;
+	}
+	return true;
+}
+
+int main( int argc, char* argv[] ) {
+	cout << "Reading win data..." << endl;
+	ifstream order_data( "order.txt" );
+	order_data >> order_win;
+	ifstream chaos_data( "chaos.txt" );
+	chaos_data >> chaos_win;
+
+	cout << "Building..." << endl;
+	compressed_tablebase tb;
+	tb.build( order_win, chaos_win );
+	cout << tb.size() << " positions stored in " << tb.bytes() << " bytes" << endl;
+	tb.save( "tablebase.bin" );
+	tb.save_header( "tablebase_data.h" );
+
+	if( argc > 1 and string( argv[1] ) == "--verify" ) {
+		compressed_tablebase loaded;
+		bool ok = loaded.load( "tablebase.bin" ) and tablebase_correct( loaded );
+		cout << "Lookups agree with order.txt and chaos.txt: " << boolalpha << ok << endl;
+#ifdef EMBEDDED_TABLEBASE
+		// the array compiled in from the previous run
+		compressed_tablebase embedded;
+		bool eok = embedded.deserialize( tablebase_data, tablebase_words ) and tablebase_correct( embedded );
+		cout << "Embedded lookups agree: " << eok << endl;
+		ok = ok and eok;
+#endif
+		return ok ? 0 : 1;
+	}
+	return 0;
+}
@@ -0,0 +1,206 @@
+// The compressed tablebase of the 4x4 board: ORDER and CHAOS results for every
+// position, read from tablebase.bin or from the array that tablebase.exe writes
+// to tablebase_data.h for compiling into an engine:
+//
+//   #include "tablebase.h"
+//   #include "tablebase_data.h"
+//   compressed_tablebase tb;
+//   tb.deserialize( tablebase_data, tablebase_words );
+//   bool winner = tb.lookup( b, ORDER );
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+
+#include <bitset>
+#include <cassert>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+#include "board_4x4.h"
+
+#define popcount64 __builtin_popcountll
+
+#ifndef ORDER
+#define CHAOS 0
+#define ORDER 1
+#endif
+
+// Only positions that are canonical, not ordered and not done need to be stored;
+// every other board is either decided by inspection or maps to a stored one.
+constexpr bool is_stored( board b ) {
+	return not is_ordered( b ) and not is_done( b ) and b == canonical( b );
+}
+
+// Stores the ORDER and CHAOS results of the stored positions, indexed by their
+// rank among the stored ternary indices. The indices themselves are kept as an
+// Elias-Fano sequence: the low low_bits bits of each index verbatim, the high part
+// in unary in a bit vector where element i sets bit ( index_i >> low_bits ) + i.
+// Every select_sample-th zero of that bit vector is sampled so the start of a
+// bucket is found in constant time.
+class compressed_tablebase {
+	static constexpr uint64_t magic = 0x314254435f43564f; // "OVC_CTB1"
+	static constexpr int select_sample = 256;
+	int32_t n;
+	int32_t low_bits;
+	std::vector<uint64_t> high;
+	std::vector<uint64_t> low;
+	std::vector<uint64_t> values;
+	std::vector<int32_t> zero_samples;
+
+	static bool bit( const std::vector<uint64_t>& v, int64_t i ) {
+		return ( v[i >> 6] >> ( i & 63 ) ) & 1;
+	}
+	static void set_bit( std::vector<uint64_t>& v, int64_t i ) {
+		v[i >> 6] |= uint64_t( 1 ) << ( i & 63 );
+	}
+	int32_t get_low( int32_t i ) const {
+		int64_t k = int64_t( i ) * low_bits;
+		uint64_t w = low[k >> 6] >> ( k & 63 );
+		if( ( k & 63 ) + low_bits > 64 )
+			w |= low[( k >> 6 ) + 1] << ( 64 - ( k & 63 ) );
+		return w & ( ( uint64_t( 1 ) << low_bits ) - 1 );
+	}
+	void set_low( int32_t i, int32_t v ) {
+		for( int j = 0; j < low_bits; ++j )
+			if( ( v >> j ) & 1 )
+				set_bit( low, int64_t( i ) * low_bits + j );
+	}
+	void build_samples() {
+		zero_samples.clear();
+		int64_t zeros = 0;
+		for( int64_t i = 0; i < int64_t( high.size() ) * 64; ++i )
+			if( not bit( high, i ) and ( zeros++ % select_sample ) == 0 )
+				zero_samples.push_back( i );
+	}
+	// position of the k-th zero (0-based) of the high bit vector
+	int64_t select0( int64_t k ) const {
+		int64_t i = zero_samples[k / select_sample];
+		k %= select_sample;
+		// finish the current word bit by bit, then skip whole words
+		while( i & 63 ) {
+			if( not bit( high, i ) and k-- == 0 )
+				return i;
+			++i;
+		}
+		while( true ) {
+			int zeros = 64 - popcount64( high[i >> 6] );
+			if( k < zeros )
+				break;
+			k -= zeros;
+			i += 64;
+		}
+		while( bit( high, i ) or k-- > 0 )
+			++i;
+		return i;
+	}
+public:
+	// rank of index among the stored indices, or -1 if it is not stored
+	int32_t rank( int32_t index ) const {
+		int64_t h = index >> low_bits;
+		int32_t l = index & ( ( 1 << low_bits ) - 1 );
+		int64_t pos = h == 0 ? 0 : select0( h-1 ) + 1; // first bit of bucket h
+		for( int64_t r = pos - h; bit( high, pos ); ++pos, ++r ) {
+			int32_t v = get_low( r );
+			if( v == l )
+				return r;
+			if( v > l )
+				break;
+		}
+		return -1;
+	}
+	// winner when player p is to move on b
+	bool lookup( board b, bool p ) const {
+		if( is_ordered( b ) )
+			return ORDER;
+		if( is_done( b ) )
+			return CHAOS;
+		int32_t r = rank( board_to_index( canonical( b ) ) );
+		assert( r >= 0 );
+		return bit( values, 2*int64_t( r ) + p );
+	}
+	int32_t size() const {
+		return n;
+	}
+	int64_t bytes() const {
+		return 8 * int64_t( high.size() + low.size() + values.size() ) + 4 * int64_t( zero_samples.size() );
+	}
+
+	void build( const std::bitset<_3pow16>& order_win, const std::bitset<_3pow16>& chaos_win ) {
+		std::vector<int32_t> stored;
+		for( int32_t i = 0; i < _3pow16; ++i )
+			if( is_stored( index_to_board( i ) ) )
+				stored.push_back( i );
+		n = stored.size();
+		low_bits = 0;
+		while( ( int64_t( n ) << ( low_bits+1 ) ) <= _3pow16 )
+			++low_bits;
+		high.assign( ( ( _3pow16 >> low_bits ) + n + 64 ) / 64 + 1, 0 );
+		low.assign( ( int64_t( n ) * low_bits + 63 ) / 64 + 1, 0 );
+		values.assign( ( 2 * int64_t( n ) + 63 ) / 64, 0 );
+		for( int32_t r = 0; r < n; ++r ) {
+			set_bit( high, int64_t( stored[r] >> low_bits ) + r );
+			set_low( r, stored[r] & ( ( 1 << low_bits ) - 1 ) );
+			if( chaos_win.test( stored[r] ) )
+				set_bit( values, 2*int64_t( r ) + CHAOS );
+			if( order_win.test( stored[r] ) )
+				set_bit( values, 2*int64_t( r ) + ORDER );
+		}
+		build_samples();
+	}
+
+	// The file is a header of four words (magic, n, low_bits, high word count)
+	// followed by the high, low and value words.
+	std::vector<uint64_t> serialize() const {
+		std::vector<uint64_t> data = { magic, uint64_t( n ), uint64_t( low_bits ), high.size() };
+		data.insert( data.end(), high.begin(), high.end() );
+		data.insert( data.end(), low.begin(), low.end() );
+		data.insert( data.end(), values.begin(), values.end() );
+		return data;
+	}
+	bool deserialize( const uint64_t* data, size_t words ) {
+		if( words < 4 or data[0] != magic )
+			return false;
+		n = data[1];
+		low_bits = data[2];
+		size_t high_words = data[3];
+		size_t low_words = ( int64_t( n ) * low_bits + 63 ) / 64 + 1;
+		size_t value_words = ( 2 * int64_t( n ) + 63 ) / 64;
+		if( words != 4 + high_words + low_words + value_words )
+			return false;
+		data += 4;
+		high.assign( data, data + high_words );
+		data += high_words;
+		low.assign( data, data + low_words );
+		data += low_words;
+		values.assign( data, data + value_words );
+		build_samples();
+		return true;
+	}
+	bool save( const char* filename ) const {
+		std::vector<uint64_t> data = serialize();
+		std::ofstream file( filename, std::ios::binary );
+		file.write( reinterpret_cast<const char*>( data.data() ), 8 * data.size() );
+		return bool( file );
+	}
+	bool load( const char* filename ) {
+		std::ifstream file( filename, std::ios::binary | std::ios::ate );
+		if( not file )
+			return false;
+		std::vector<uint64_t> data( file.tellg() / 8 );
+		file.seekg( 0 );
+		file.read( reinterpret_cast<char*>( data.data() ), 8 * data.size() );
+		return bool( file ) and deserialize( data.data(), data.size() );
+	}
+	// writes the serialized table as a C++ array so it can be compiled into an engine
+	void save_header( const char* filename ) const {
+		std::vector<uint64_t> data = serialize();
+		std::ofstream file( filename );
+		file << "// generated by tablebase.exe\n#include <cstdint>\n#include <cstddef>\n";
+		file << "const size_t tablebase_words = " << data.size() << ";\n";
+		file << "const uint64_t tablebase_data[] = {\n";
+		for( size_t i = 0; i < data.size(); ++i )
+			file << "0x" << std::hex << data[i] << std::dec << "ULL" << ( ( i % 6 == 5 ) ? ",\n" : "," );
+		file << "\n};\n";
+	}
+};
+
+#endif